@@ -0,0 +1,678 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark of each plugin in the library, driven through the Vamp::Plugin
+ * API with deterministic synthetic signals.
+ *
+ * For each plugin, signal and length, the plugin is run in a child process so
+ * that its peak resident set size can be measured on its own. The input of a
+ * batch of blocks is prepared before the batch is timed, so only process()
+ * is measured, and the number of heap allocations made during process() is
+ * counted by replacing the global operator new and delete.
+ *
+ * With --check-allocations, the program fails if any process() call in the
+ * second half of a run makes more allocations than are needed to build the
+ * features it returns, so that steady-state processing is known not to
+ * allocate. Plugins with a streaming mode are checked in it. Plugins without
+ * one, such as Intensity, SpectralContrast and SpectralFlux, are checked in
+ * batch mode, as is the bundle with the stages that have a streaming mode
+ * turned off, as those keep a history for getRemainingFeatures().
+ *
+ * Usage: bbc-vamp-bench [--lengths 10,60,600] [--plugins bbc-energy,...]
+ *                       [--signals noise,tones,clicks,silence,speech]
+ *                       [--rate 44100] [--json bench.json]
+ *                       [--check-allocations]
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Energy.h"
+#include "Intensity.h"
+#include "SpectralFlux.h"
+#include "Rhythm.h"
+#include "SpectralContrast.h"
+#include "SpeechMusicSegmenter.h"
+#include "Peaks.h"
+#include "LowLevelBundle.h"
+#include "FourierTransform.h"
+
+using std::string;
+using std::vector;
+
+// dynamic exception specifications were removed in C++17
+#if __cplusplus >= 201103L
+#define BENCH_THROWS_BAD_ALLOC
+#define BENCH_NO_THROW noexcept
+#else
+#define BENCH_THROWS_BAD_ALLOC throw(std::bad_alloc)
+#define BENCH_NO_THROW throw()
+#endif
+
+// keeps malloc() and free() out of the callers of new and delete, where GCC
+// would otherwise warn that they do not match
+#if defined(__GNUC__)
+#define BENCH_NO_INLINE __attribute__((noinline))
+#else
+#define BENCH_NO_INLINE
+#endif
+
+static long allocationCount = 0;
+
+BENCH_NO_INLINE void *operator new(size_t size) BENCH_THROWS_BAD_ALLOC {
+  allocationCount++;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+BENCH_NO_INLINE void *operator new[](size_t size) BENCH_THROWS_BAD_ALLOC {
+  allocationCount++;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+BENCH_NO_INLINE void operator delete(void *p) BENCH_NO_THROW {
+  free(p);
+}
+
+BENCH_NO_INLINE void operator delete[](void *p) BENCH_NO_THROW {
+  free(p);
+}
+
+// sized deallocation, used from C++14, must not bypass the versions above
+BENCH_NO_INLINE void operator delete(void *p, size_t) BENCH_NO_THROW {
+  operator delete(p);
+}
+
+BENCH_NO_INLINE void operator delete[](void *p, size_t) BENCH_NO_THROW {
+  operator delete[](p);
+}
+
+enum {
+  NoiseSignal,
+  ToneSignal,
+  ClickSignal,
+  SilenceSignal,
+  SpeechSignal,
+  SignalCount
+};
+
+static const char *signalNames[SignalCount] = {
+  "noise", "tones", "clicks", "silence", "speech"
+};
+
+enum {
+  DefaultRun,    /*!< Plugin parameters left at their defaults */
+  StreamingRun,  /*!< Streaming mode turned on wherever there is one */
+  BatchRun,      /*!< Stages with a streaming mode turned off */
+  RunModeCount
+};
+
+static const char *runModeNames[RunModeCount] = {
+  "default", "streaming", "batch"
+};
+
+static const int pluginCount = 8;
+
+/*!
+ * \brief Creates a plugin, in the same order as vampGetPluginDescriptor() in
+ * plugins.cpp.
+ */
+static Vamp::Plugin *createPlugin(int index, float sampleRate) {
+  switch (index) {
+    case 0: return new Energy(sampleRate);
+    case 1: return new Intensity(sampleRate);
+    case 2: return new SpectralFlux(sampleRate);
+    case 3: return new Rhythm(sampleRate);
+    case 4: return new SpectralContrast(sampleRate);
+    case 5: return new SpeechMusicSegmenter(sampleRate);
+    case 6: return new Peaks(sampleRate);
+    case 7: return new LowLevelBundle(sampleRate);
+    default: return NULL;
+  }
+}
+
+/*!
+ * \brief Generates one of the synthetic test signals, the same every run.
+ */
+class SignalGenerator {
+ public:
+  SignalGenerator(int kind_in, float sampleRate_in)
+      : kind(kind_in), sampleRate(sampleRate_in), seed(12345), position(0),
+        pitchPhase(0), resonance1(0), resonance2(0), syllableGain(1),
+        lastSyllable(-1) {
+    const double freqs[3] = { 220.0, 440.0 * 1.25, 3520.0 };
+    for (int k = 0; k < 3; k++) {
+      double w = 2 * M_PI * freqs[k] / sampleRate;
+      stepRe[k] = cos(w);
+      stepIm[k] = sin(w);
+      toneRe[k] = 1;
+      toneIm[k] = 0;
+    }
+  }
+
+  void generate(float *buffer, int length) {
+    for (int i = 0; i < length; i++, position++)
+      buffer[i] = nextSample();
+  }
+
+ private:
+  float noise() {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) / 16777216.f - 0.5f;
+  }
+
+  float nextSample() {
+    double t = position / sampleRate;
+    switch (kind) {
+      case NoiseSignal:
+        return noise();
+      case ToneSignal: {
+        // rotate a phasor for each tone, correcting its length now and then
+        float x = 0;
+        for (int k = 0; k < 3; k++) {
+          double re = toneRe[k] * stepRe[k] - toneIm[k] * stepIm[k];
+          toneIm[k] = toneRe[k] * stepIm[k] + toneIm[k] * stepRe[k];
+          toneRe[k] = re;
+          if ((position & 4095) == 0) {
+            double norm = sqrt(re * re + toneIm[k] * toneIm[k]);
+            toneRe[k] /= norm;
+            toneIm[k] /= norm;
+          }
+          x += 0.2f * toneIm[k];
+        }
+        return x;
+      }
+      case ClickSignal: {
+        // decaying bursts of noise at 120 bpm over a quiet floor
+        double beat = fmod(t, 0.5);
+        float x = 0.001f * noise();
+        if (beat < 0.01)
+          x += 0.8f * noise() * exp(-beat * 400);
+        return x;
+      }
+      case SilenceSignal:
+        return 0;
+      default: {
+        // a glottal pulse train with a gliding pitch through a resonance,
+        // gated into syllables of 250ms with random gaps between them
+        long syllable = (long) (t * 4);
+        if (syllable != lastSyllable) {
+          lastSyllable = syllable;
+          syllableGain = (noise() > -0.2f) ? 1.f : 0.f;
+        }
+        double pitch = 140 + 40 * sin(2 * M_PI * 0.7 * t);
+        pitchPhase += pitch / sampleRate;
+        float excitation = 0.01f * noise();
+        if (pitchPhase >= 1) {
+          pitchPhase -= 1;
+          excitation += 1;
+        }
+        double r = 0.97, w = 2 * M_PI * 700 / sampleRate;
+        double y = excitation + 2 * r * cos(w) * resonance1
+            - r * r * resonance2;
+        resonance2 = resonance1;
+        resonance1 = y;
+        double envelope = 0.5 - 0.5 * cos(2 * M_PI * 4 * t);
+        return (float) (0.05 * y * envelope * syllableGain);
+      }
+    }
+  }
+
+  int kind;
+  float sampleRate;
+  unsigned int seed;
+  long position;
+  double stepRe[3], stepIm[3], toneRe[3], toneIm[3];
+  double pitchPhase, resonance1, resonance2;
+  float syllableGain;
+  long lastSyllable;
+};
+
+/*!
+ * \brief Timings of a single run, passed back from the child process.
+ */
+struct RunResult {
+  int ok;                   /*!< Whether the plugin initialised */
+  int blockSize;            /*!< Block size used */
+  int stepSize;             /*!< Step size used */
+  long frames;              /*!< Number of blocks processed */
+  double processSeconds;    /*!< Total time spent in process() */
+  double remainingSeconds;  /*!< Time spent in getRemainingFeatures() */
+  long allocations;         /*!< Heap allocations made during process() */
+  long pluginAllocations;   /*!< Allocations made during process() in the
+                                 second half of the run, other than those
+                                 needed to build the returned features */
+  long features;            /*!< Number of features returned */
+  char identifier[64];      /*!< Identifier of the plugin */
+};
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static long countFeatures(const Vamp::Plugin::FeatureSet &features) {
+  long count = 0;
+  for (Vamp::Plugin::FeatureSet::const_iterator it = features.begin();
+       it != features.end(); ++it)
+    count += it->second.size();
+  return count;
+}
+
+/*!
+ * \brief Returns whether a parameter turns on streaming mode, for a plugin or
+ * for one of the stages of the bundle.
+ */
+static bool isStreamingParameter(const string &identifier) {
+  const string suffix = "_streaming";
+  return identifier == "streaming"
+      || (identifier.size() > suffix.size()
+          && identifier.compare(identifier.size() - suffix.size(),
+                                suffix.size(), suffix) == 0);
+}
+
+/*!
+ * \brief Returns whether a plugin has a streaming mode, and whether it has
+ * stages which can be switched off.
+ */
+static void describePlugin(Vamp::Plugin *plugin, bool &streaming_out,
+                           bool &stages_out) {
+  streaming_out = false;
+  stages_out = false;
+  Vamp::Plugin::ParameterList parameters = plugin->getParameterDescriptors();
+  for (size_t i = 0; i < parameters.size(); i++) {
+    const string& identifier = parameters[i].identifier;
+    if (isStreamingParameter(identifier))
+      streaming_out = true;
+    if (identifier.compare(0, 4, "use_") == 0)
+      stages_out = true;
+  }
+}
+
+/*!
+ * \brief Sets the parameters of a plugin for a run mode. For a batch run,
+ * each stage with a streaming mode is switched off, as in batch mode it keeps
+ * a history of every block for getRemainingFeatures().
+ */
+static void setRunMode(Vamp::Plugin *plugin, int mode) {
+  Vamp::Plugin::ParameterList parameters = plugin->getParameterDescriptors();
+  for (size_t i = 0; i < parameters.size(); i++) {
+    const string& identifier = parameters[i].identifier;
+    if (!isStreamingParameter(identifier))
+      continue;
+    if (mode == StreamingRun) {
+      plugin->setParameter(identifier, 1);
+    } else if (mode == BatchRun && identifier != "streaming") {
+      string stage = identifier.substr(0, identifier.size() - 10);
+      plugin->setParameter("use_" + stage, 0);
+    }
+  }
+}
+
+/*!
+ * \brief Returns the number of allocations needed to build a copy of a
+ * feature set in the way the plugins build theirs, one feature at a time.
+ */
+static long featureAllocations(const Vamp::Plugin::FeatureSet &features) {
+  long before = allocationCount;
+  Vamp::Plugin::FeatureSet copy;
+  for (Vamp::Plugin::FeatureSet::const_iterator it = features.begin();
+       it != features.end(); ++it) {
+    Vamp::Plugin::FeatureList &list = copy[it->first];
+    for (size_t i = 0; i < it->second.size(); i++) {
+      Vamp::Plugin::Feature feature = it->second[i];
+      list.push_back(feature);
+    }
+  }
+  return allocationCount - before;
+}
+
+/*!
+ * \brief Runs a plugin over a signal of the given length, with its parameters
+ * set for the run mode. When checking, allocations made by process() other
+ * than for its features are counted.
+ */
+static RunResult runPlugin(int pluginIndex, int signal, double seconds,
+                           float sampleRate, int mode, bool checking) {
+  RunResult result;
+  memset(&result, 0, sizeof(result));
+
+  Vamp::Plugin *plugin = createPlugin(pluginIndex, sampleRate);
+  setRunMode(plugin, mode);
+  strncpy(result.identifier, plugin->getIdentifier().c_str(),
+          sizeof(result.identifier) - 1);
+  bool frequencyDomain =
+      plugin->getInputDomain() == Vamp::Plugin::FrequencyDomain;
+  int blockSize = plugin->getPreferredBlockSize();
+  if (blockSize == 0)
+    blockSize = 1024;
+  int stepSize = plugin->getPreferredStepSize();
+  if (stepSize == 0)
+    stepSize = frequencyDomain ? blockSize / 2 : blockSize;
+  result.blockSize = blockSize;
+  result.stepSize = stepSize;
+  if (!plugin->initialise(1, stepSize, blockSize)) {
+    delete plugin;
+    return result;
+  }
+  result.ok = 1;
+
+  long samples = (long) (seconds * sampleRate);
+  long frames = samples < blockSize ? 0 : (samples - blockSize) / stepSize + 1;
+  result.frames = frames;
+
+  SignalGenerator generator(signal, sampleRate);
+  FourierTransform fft;
+  fft.initialise(blockSize);
+  vector<double> real(blockSize), imag(blockSize), window(blockSize);
+  for (int i = 0; i < blockSize; i++)
+    window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / blockSize);
+
+  // prepare a batch of blocks at a time, then time the batch
+  const int batchFrames = 256;
+  int inputSize = frequencyDomain ? blockSize + 2 : blockSize;
+  vector<float> input(batchFrames * inputSize);
+  vector<float> block(blockSize, 0.f);
+  generator.generate(&block[0], blockSize - stepSize);
+
+  for (long frame = 0; frame < frames; frame += batchFrames) {
+    int count = (int) std::min<long>(batchFrames, frames - frame);
+    for (int b = 0; b < count; b++) {
+      std::copy(block.begin() + stepSize, block.end(), block.begin());
+      generator.generate(&block[blockSize - stepSize], stepSize);
+      float *in = &input[b * inputSize];
+      if (frequencyDomain) {
+        for (int i = 0; i < blockSize; i++) {
+          real[i] = block[i] * window[i];
+          imag[i] = 0;
+        }
+        fft.forward(&real[0], &imag[0]);
+        for (int i = 0; i <= blockSize / 2; i++) {
+          in[i * 2] = real[i];
+          in[i * 2 + 1] = imag[i];
+        }
+      } else {
+        std::copy(block.begin(), block.end(), in);
+      }
+    }
+
+    long allocationsBefore = allocationCount;
+    long rebuilt = 0;
+    double start = now();
+    for (int b = 0; b < count; b++) {
+      const float *in = &input[b * inputSize];
+      Vamp::RealTime timestamp = Vamp::RealTime::frame2RealTime(
+          (frame + b) * stepSize, (unsigned int) sampleRate);
+      long made = allocationCount;
+      Vamp::Plugin::FeatureSet features = plugin->process(&in, timestamp);
+      made = allocationCount - made;
+      result.features += countFeatures(features);
+      if (checking && frame + b >= frames / 2) {
+        long featureMade = featureAllocations(features);
+        rebuilt += featureMade;
+        result.pluginAllocations += std::max(0L, made - featureMade);
+      }
+    }
+    result.processSeconds += now() - start;
+    result.allocations += allocationCount - allocationsBefore - rebuilt;
+  }
+
+  double start = now();
+  result.features += countFeatures(plugin->getRemainingFeatures());
+  result.remainingSeconds = now() - start;
+
+  delete plugin;
+  return result;
+}
+
+/*!
+ * \brief Runs a plugin in a child process, returning its peak resident set
+ * size in kilobytes through peakKb.
+ */
+static bool runChild(int pluginIndex, int signal, double seconds,
+                     float sampleRate, int mode, bool checking,
+                     RunResult &result, long &peakKb) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return false;
+
+  pid_t pid = fork();
+  if (pid < 0)
+    return false;
+  if (pid == 0) {
+    close(fds[0]);
+    RunResult childResult = runPlugin(pluginIndex, signal, seconds,
+                                      sampleRate, mode, checking);
+    ssize_t written = write(fds[1], &childResult, sizeof(childResult));
+    _exit(written == (ssize_t) sizeof(childResult) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  ssize_t got = 0;
+  char *target = (char *) &result;
+  while (got < (ssize_t) sizeof(result)) {
+    ssize_t n = read(fds[0], target + got, sizeof(result) - got);
+    if (n <= 0)
+      break;
+    got += n;
+  }
+  close(fds[0]);
+
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0)
+    return false;
+#if defined(__APPLE__)
+  peakKb = usage.ru_maxrss / 1024;
+#else
+  peakKb = usage.ru_maxrss;
+#endif
+  return got == (ssize_t) sizeof(result) && WIFEXITED(status)
+      && WEXITSTATUS(status) == 0;
+}
+
+static const char *usage =
+    "Usage: bbc-vamp-bench [--lengths 10,60,600] [--plugins bbc-energy,...]\n"
+    "                      [--signals noise,tones,clicks,silence,speech]\n"
+    "                      [--rate 44100] [--json bench.json]\n"
+    "                      [--check-allocations]\n";
+
+static vector<string> splitList(const char *list) {
+  vector<string> items;
+  string item;
+  for (const char *c = list; ; c++) {
+    if (*c == ',' || *c == '\0') {
+      if (!item.empty())
+        items.push_back(item);
+      item.clear();
+      if (*c == '\0')
+        break;
+    } else {
+      item += *c;
+    }
+  }
+  return items;
+}
+
+static bool listed(const vector<string> &list, const string &name) {
+  if (list.empty())
+    return true;
+  for (size_t i = 0; i < list.size(); i++)
+    if (list[i] == name)
+      return true;
+  return false;
+}
+
+int main(int argc, char **argv) {
+  vector<double> lengths;
+  vector<string> plugins, signals;
+  float sampleRate = 44100;
+  string jsonPath = "bench.json";
+  bool checkAllocations = false;
+
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+    if (option == "--help" || option == "-h") {
+      printf("%s", usage);
+      return 0;
+    }
+    if (option == "--check-allocations") {
+      checkAllocations = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      fprintf(stderr, "Missing value for %s\n%s", argv[i], usage);
+      return 1;
+    }
+    const char *value = argv[++i];
+    if (option == "--lengths") {
+      vector<string> items = splitList(value);
+      for (size_t k = 0; k < items.size(); k++)
+        lengths.push_back(atof(items[k].c_str()));
+    } else if (option == "--plugins") {
+      plugins = splitList(value);
+    } else if (option == "--signals") {
+      signals = splitList(value);
+    } else if (option == "--rate") {
+      sampleRate = atof(value);
+    } else if (option == "--json") {
+      jsonPath = value;
+    } else {
+      fprintf(stderr, "Unknown option %s\n%s", option.c_str(), usage);
+      return 1;
+    }
+  }
+  if (lengths.empty() && checkAllocations) {
+    lengths.push_back(30);
+  } else if (lengths.empty()) {
+    lengths.push_back(10);
+    lengths.push_back(60);
+    lengths.push_back(600);
+  }
+
+  FILE *json = fopen(jsonPath.c_str(), "w");
+  if (!json) {
+    fprintf(stderr, "Cannot write %s\n", jsonPath.c_str());
+    return 1;
+  }
+  fprintf(json, "[\n");
+
+  printf("%-28s %-8s %-9s %8s %7s %12s %12s %10s %10s %10s\n", "plugin",
+         "signal", "mode", "seconds", "frames", "ns/frame", "remaining",
+         "x realtime", "allocs/fr", "peak KB");
+
+  bool first = true;
+  bool failed = false;
+  for (int p = 0; p < pluginCount; p++) {
+    Vamp::Plugin *plugin = createPlugin(p, sampleRate);
+    string identifier = plugin->getIdentifier();
+    bool hasStreaming, hasStages;
+    describePlugin(plugin, hasStreaming, hasStages);
+    delete plugin;
+    if (!listed(plugins, identifier))
+      continue;
+
+    // check streaming mode where there is one, and batch mode where it does
+    // not keep a history
+    vector<int> modes;
+    if (!checkAllocations) {
+      modes.push_back(DefaultRun);
+    } else {
+      if (hasStreaming)
+        modes.push_back(StreamingRun);
+      if (!hasStreaming || hasStages)
+        modes.push_back(BatchRun);
+    }
+
+    for (int s = 0; s < SignalCount; s++) {
+      if (!listed(signals, signalNames[s]))
+        continue;
+
+      for (size_t m = 0; m < modes.size(); m++) {
+        for (size_t l = 0; l < lengths.size(); l++) {
+          const char *mode = runModeNames[modes[m]];
+          RunResult result;
+          long peakKb = 0;
+          if (!runChild(p, s, lengths[l], sampleRate, modes[m],
+                        checkAllocations, result, peakKb) || !result.ok) {
+            fprintf(stderr, "%s failed on %s for %gs\n", identifier.c_str(),
+                    signalNames[s], lengths[l]);
+            failed = true;
+            continue;
+          }
+          if (checkAllocations && result.pluginAllocations != 0) {
+            fprintf(stderr, "%s kept %ld allocations from process() after "
+                    "warming up on %s in %s mode\n", identifier.c_str(),
+                    result.pluginAllocations, signalNames[s], mode);
+            failed = true;
+          }
+
+          double perFrame = result.frames
+              ? result.processSeconds * 1e9 / result.frames : 0;
+          double total = result.processSeconds + result.remainingSeconds;
+          double realTime = total > 0 ? lengths[l] / total : 0;
+          double allocations = result.frames
+              ? (double) result.allocations / result.frames : 0;
+
+          printf("%-28s %-8s %-9s %8g %7ld %12.1f %10.3fms %10.1f %10.2f "
+                 "%10ld\n", identifier.c_str(), signalNames[s], mode,
+                 lengths[l], result.frames, perFrame,
+                 result.remainingSeconds * 1e3, realTime, allocations, peakKb);
+          fflush(stdout);
+
+          fprintf(json,
+                  "%s  {\"plugin\": \"%s\", \"signal\": \"%s\", "
+                  "\"seconds\": %g, \"sample_rate\": %g, \"block_size\": %d, "
+                  "\"step_size\": %d, \"frames\": %ld, "
+                  "\"process_ns_per_frame\": %.3f, "
+                  "\"remaining_seconds\": %.6f, \"real_time_factor\": %.3f, "
+                  "\"allocations_per_frame\": %.3f, "
+                  "\"plugin_allocations\": %ld, \"mode\": \"%s\", "
+                  "\"features\": %ld, \"peak_rss_kb\": %ld}",
+                  first ? "" : ",\n", identifier.c_str(), signalNames[s],
+                  lengths[l], sampleRate, result.blockSize, result.stepSize,
+                  result.frames, perFrame, result.remainingSeconds, realTime,
+                  allocations, result.pluginAllocations, mode,
+                  result.features, peakKb);
+          first = false;
+        }
+      }
+    }
+  }
+
+  fprintf(json, "\n]\n");
+  fclose(json);
+  return failed ? 1 : 0;
+}
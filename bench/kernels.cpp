@@ -0,0 +1,447 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmarks of the inner routines of the plugins, each timed on its own
+ * over a sweep of input lengths and parameter values.
+ *
+ * Protected routines are reached through subclasses of the plugins. For each
+ * kernel and parameter value, the time per call is printed for each input
+ * length along with the local slope of log(time) against log(length), and
+ * the slope fitted over the whole sweep, so that routines which scale worse
+ * than linearly, or blow up for some parameter values, stand out.
+ *
+ * Usage: bbc-vamp-bench-kernels [--max-log2 20] [--min-time 0.05]
+ *                               [--kernels movingAverage,...]
+ *                               [--json kernels.json]
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+
+#include "Energy.h"
+#include "Intensity.h"
+#include "Rhythm.h"
+#include "SpectralContrast.h"
+#include "SpeechMusicSegmenter.h"
+
+using std::string;
+using std::vector;
+
+static const float inputSampleRate = 44100;
+
+static double now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+static unsigned int seed = 12345;
+
+static float randomValue() {
+  seed = seed * 1664525u + 1013904223u;
+  return (seed >> 8) / 16777216.f;
+}
+
+/*!
+ * \brief A routine to be timed, prepared for a given input length and
+ * parameter value before it is run.
+ */
+class Kernel {
+ public:
+  virtual ~Kernel() {}
+  virtual void prepare(int length, float value) = 0;
+  virtual void run() = 0;
+};
+
+/*!
+ * \brief Fills a curve with noise and regular peaks, like an onset curve.
+ */
+static void makeCurve(vector<float>& curve, int length) {
+  curve.resize(length);
+  for (int i = 0; i < length; i++)
+    curve[i] = randomValue() + (i % 43 == 0 ? 4.f : 0.f);
+}
+
+/*!
+ * \brief The stages of the Rhythm plugin which run over the whole signal.
+ */
+class RhythmKernel : public Rhythm, public Kernel {
+ public:
+  enum Routine {
+    Autocorrelation,
+    DecimatedAutocorrelation,
+    MovingAverage,
+    OnsetConvolve,
+    FindOnsetPeaks,
+    SumIntensity
+  };
+
+  RhythmKernel(Routine routine_in, const char *parameter_in)
+      : Rhythm(inputSampleRate), routine(routine_in),
+        parameter(parameter_in) {}
+
+  void prepare(int length, float value) {
+    if (!parameter.empty())
+      setParameter(parameter, value);
+    initialise(1, getPreferredStepSize(), getPreferredBlockSize());
+    makeCurve(curve, length);
+    output.assign(length, 0.f);
+    difference.assign(length, 0.f);
+    if (routine == SumIntensity) {
+      vector<float> total(numBands);
+      for (int frame = 0; frame < length; frame++) {
+        for (int subBand = 0; subBand < numBands; subBand++)
+          total[subBand] = randomValue();
+        appendIntensity(total);
+      }
+    }
+  }
+
+  void run() {
+    int length = curve.size();
+    switch (routine) {
+      case Autocorrelation:
+        autocor.clear();
+        autocorrelation(&curve[0], length, firstShift, lastShift, autocor);
+        break;
+      case DecimatedAutocorrelation:
+        autocor.clear();
+        peaks.clear();
+        valleys.clear();
+        decimatedAutocorrelation(&curve[0], length, autocor, peaks, valleys);
+        break;
+      case MovingAverage:
+        movingAverage(&curve[0], length, average_window, threshold,
+                      &output[0], &difference[0]);
+        break;
+      case OnsetConvolve:
+        onsetConvolve(&curve[0], length, &output[0]);
+        break;
+      case FindOnsetPeaks:
+        peaks.clear();
+        findOnsetPeaks(&curve[0], length, peak_window, peaks);
+        break;
+      case SumIntensity:
+        sumIntensity(&output[0]);
+        break;
+    }
+  }
+
+ private:
+  Routine routine;
+  string parameter;
+  vector<float> curve, output, difference, autocor;
+  vector<int> peaks, valleys;
+};
+
+/*!
+ * \brief The percentile and dip count over the sliding window of the Energy
+ * plugin, as run at the end of the stream.
+ */
+class EnergyKernel : public Energy, public Kernel {
+ public:
+  EnergyKernel() : Energy(inputSampleRate) {}
+
+  void prepare(int length, float value) {
+    setParameter("avgwindow", value);
+    initialise(1, getPreferredStepSize(), getPreferredBlockSize());
+    rmsEnergy.resize(length);
+    for (int i = 0; i < length; i++)
+      rmsEnergy[i] = randomValue();
+  }
+
+  void run() {
+    getRemainingFeatures();
+  }
+};
+
+/*!
+ * \brief The skewness of the zero crossing rate over the sliding window of
+ * the speech/music segmenter.
+ */
+class SegmenterKernel : public SpeechMusicSegmenter, public Kernel {
+ public:
+  SegmenterKernel() : SpeechMusicSegmenter(inputSampleRate) {}
+
+  void prepare(int length, float value) {
+    setParameter("resolution", value);
+    initialise(1, getPreferredStepSize(), getPreferredBlockSize());
+    reset();
+    for (int i = 0; i < length; i++)
+      storeZeroCrossingCount((int) (randomValue() * 200));
+    m_nframes = length;
+  }
+
+  void run() {
+    getSkewnessFunction();
+  }
+};
+
+/*!
+ * \brief The per-block loop over the sub-bands of a plugin, given the
+ * magnitude of each bin.
+ */
+template <class PluginType>
+class BandKernel : public Kernel {
+ public:
+  BandKernel() : plugin(NULL), calls(0) {}
+  ~BandKernel() { delete plugin; }
+
+  void prepare(int length, float value) {
+    delete plugin;
+    plugin = new PluginType(inputSampleRate);
+    plugin->setParameter("numBands", value);
+    plugin->initialise(1, length, length * 2);
+    magnitudes.resize(length);
+    for (int i = 0; i < length; i++)
+      magnitudes[i] = randomValue();
+  }
+
+  void run() {
+    // stop the plugins which keep every block from growing without bound
+    if (++calls % 65536 == 0)
+      plugin->reset();
+    plugin->processMagnitudes(&magnitudes[0], Vamp::RealTime(0, 0));
+  }
+
+ private:
+  PluginType *plugin;
+  vector<float> magnitudes;
+  long calls;
+};
+
+/*!
+ * \brief A kernel with the parameter and lengths it is swept over.
+ */
+struct Sweep {
+  const char *name;       /*!< Name of the routine */
+  const char *parameter;  /*!< Parameter which is varied, if any */
+  vector<float> values;   /*!< Values of the parameter */
+  int firstLog2;          /*!< Shortest input length, as a power of two */
+  int lastLog2;           /*!< Longest input length, as a power of two */
+  int stepLog2;           /*!< Ratio between lengths, as a power of two */
+  Kernel *kernel;         /*!< The routine */
+  const char *unit;       /*!< What the input length counts */
+};
+
+static Sweep makeSweep(const char *name, const char *parameter,
+                       const char *values, int firstLog2, int lastLog2,
+                       int stepLog2, Kernel *kernel, const char *unit) {
+  Sweep sweep;
+  sweep.name = name;
+  sweep.parameter = parameter;
+  for (const char *c = values; *c; ) {
+    char *end;
+    sweep.values.push_back(strtod(c, &end));
+    c = *end ? end + 1 : end;
+  }
+  sweep.firstLog2 = firstLog2;
+  sweep.lastLog2 = lastLog2;
+  sweep.stepLog2 = stepLog2;
+  sweep.kernel = kernel;
+  sweep.unit = unit;
+  return sweep;
+}
+
+/*!
+ * \brief Returns the mean time of a call in seconds, doubling the number of
+ * calls until they take at least minTime.
+ */
+static double timeKernel(Kernel *kernel, double minTime) {
+  for (long calls = 1; ; calls *= 2) {
+    double start = now();
+    for (long i = 0; i < calls; i++)
+      kernel->run();
+    double elapsed = now() - start;
+    if (elapsed >= minTime)
+      return elapsed / calls;
+  }
+}
+
+/*!
+ * \brief Returns the least squares slope of log(time) against log(length).
+ */
+static double fitSlope(const vector<int>& lengths,
+                       const vector<double>& times) {
+  int n = lengths.size();
+  if (n < 2)
+    return 0;
+  double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+  for (int i = 0; i < n; i++) {
+    double x = log((double) lengths[i]), y = log(times[i]);
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+  }
+  return (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX);
+}
+
+static const char *usage =
+    "Usage: bbc-vamp-bench-kernels [--max-log2 20] [--min-time 0.05]\n"
+    "                              [--kernels movingAverage,...]\n"
+    "                              [--json kernels.json]\n";
+
+static bool listed(const string& list, const string& name) {
+  if (list.empty())
+    return true;
+  string padded = "," + list + ",";
+  return padded.find("," + name + ",") != string::npos;
+}
+
+int main(int argc, char **argv) {
+  int maxLog2 = 20;
+  double minTime = 0.05;
+  string kernels;
+  string jsonPath = "kernels.json";
+
+  for (int i = 1; i < argc; i++) {
+    string option = argv[i];
+    if (option == "--help" || option == "-h") {
+      printf("%s", usage);
+      return 0;
+    }
+    if (i + 1 == argc) {
+      fprintf(stderr, "Missing value for %s\n%s", argv[i], usage);
+      return 1;
+    }
+    const char *value = argv[++i];
+    if (option == "--max-log2") {
+      maxLog2 = atoi(value);
+    } else if (option == "--min-time") {
+      minTime = atof(value);
+    } else if (option == "--kernels") {
+      kernels = value;
+    } else if (option == "--json") {
+      jsonPath = value;
+    } else {
+      fprintf(stderr, "Unknown option %s\n%s", option.c_str(), usage);
+      return 1;
+    }
+  }
+
+  vector<Sweep> sweeps;
+  sweeps.push_back(makeSweep(
+      "autocorrelation", "min_bpm", "5,12,60", 10, maxLog2, 2,
+      new RhythmKernel(RhythmKernel::Autocorrelation, "min_bpm"), "frames"));
+  sweeps.push_back(makeSweep(
+      "decimatedAutocorrelation", "decimation", "1,2,8", 10, maxLog2, 2,
+      new RhythmKernel(RhythmKernel::DecimatedAutocorrelation, "decimation"),
+      "frames"));
+  sweeps.push_back(makeSweep(
+      "movingAverage", "average_window", "1,200,500", 10, maxLog2, 2,
+      new RhythmKernel(RhythmKernel::MovingAverage, "average_window"),
+      "frames"));
+  sweeps.push_back(makeSweep(
+      "onsetConvolve", "", "0", 10, maxLog2, 2,
+      new RhythmKernel(RhythmKernel::OnsetConvolve, ""), "frames"));
+  sweeps.push_back(makeSweep(
+      "findOnsetPeaks", "peak_window", "1,6,20", 10, maxLog2, 2,
+      new RhythmKernel(RhythmKernel::FindOnsetPeaks, "peak_window"),
+      "frames"));
+  sweeps.push_back(makeSweep(
+      "sumIntensity", "numBands", "2,7,50", 10, maxLog2, 2,
+      new RhythmKernel(RhythmKernel::SumIntensity, "numBands"), "frames"));
+  sweeps.push_back(makeSweep(
+      "energyWindow", "avgwindow", "0.1,1,10", 10, maxLog2, 2,
+      new EnergyKernel(), "frames"));
+  sweeps.push_back(makeSweep(
+      "getSkewnessFunction", "resolution", "16,256,1024", 10, maxLog2, 2,
+      new SegmenterKernel(), "frames"));
+  sweeps.push_back(makeSweep(
+      "intensityBands", "numBands", "2,7,50", 7, 13, 1,
+      new BandKernel<Intensity>(), "bins"));
+  sweeps.push_back(makeSweep(
+      "contrastBands", "numBands", "2,7,50", 7, 13, 1,
+      new BandKernel<SpectralContrast>(), "bins"));
+  sweeps.push_back(makeSweep(
+      "rhythmBands", "numBands", "2,7,50", 7, 13, 1,
+      new BandKernel<Rhythm>(), "bins"));
+
+  FILE *json = fopen(jsonPath.c_str(), "w");
+  if (!json) {
+    fprintf(stderr, "Cannot write %s\n", jsonPath.c_str());
+    return 1;
+  }
+  fprintf(json, "[\n");
+
+  printf("%-26s %-22s %10s %14s %12s %7s\n", "kernel", "parameter", "length",
+         "ns/call", "ns/element", "slope");
+
+  bool first = true;
+  for (size_t s = 0; s < sweeps.size(); s++) {
+    const Sweep& sweep = sweeps[s];
+    if (!listed(kernels, sweep.name))
+      continue;
+
+    for (size_t v = 0; v < sweep.values.size(); v++) {
+      char setting[64] = "-";
+      if (*sweep.parameter)
+        snprintf(setting, sizeof(setting), "%s=%g", sweep.parameter,
+                 sweep.values[v]);
+
+      vector<int> lengths;
+      vector<double> times;
+      for (int log2 = sweep.firstLog2; log2 <= sweep.lastLog2;
+           log2 += sweep.stepLog2) {
+        int length = 1 << log2;
+        sweep.kernel->prepare(length, sweep.values[v]);
+        double seconds = timeKernel(sweep.kernel, minTime);
+
+        char slope[16] = "";
+        if (!times.empty())
+          snprintf(slope, sizeof(slope), "%.2f",
+                   log(seconds / times.back())
+                       / log((double) length / lengths.back()));
+        lengths.push_back(length);
+        times.push_back(seconds);
+
+        printf("%-26s %-22s %10d %14.1f %12.3f %7s\n", sweep.name, setting,
+               length, seconds * 1e9, seconds * 1e9 / length, slope);
+        fflush(stdout);
+      }
+
+      double slope = fitSlope(lengths, times);
+      printf("%-26s %-22s %10s %14s %12s %7.2f\n", sweep.name, setting,
+             "fit", "", "", slope);
+
+      fprintf(json,
+              "%s  {\"kernel\": \"%s\", \"parameter\": \"%s\", "
+              "\"value\": %g, \"unit\": \"%s\", \"slope\": %.3f, "
+              "\"points\": [",
+              first ? "" : ",\n", sweep.name, sweep.parameter,
+              sweep.values[v], sweep.unit, slope);
+      for (size_t i = 0; i < lengths.size(); i++)
+        fprintf(json, "%s{\"length\": %d, \"ns_per_call\": %.3f}",
+                i ? ", " : "", lengths[i], times[i] * 1e9);
+      fprintf(json, "]}");
+      first = false;
+    }
+  }
+
+  fprintf(json, "\n]\n");
+  fclose(json);
+
+  for (size_t s = 0; s < sweeps.size(); s++)
+    delete sweeps[s].kernel;
+  return 0;
+}
@@ -0,0 +1,90 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "BandMap.h"
+
+BandMap::BandMap() {
+  numBands = 0;
+  bandStart.assign(1, 0);
+}
+
+/*!
+ * \brief Calculates the range of bins covered by each sub-band.
+ *
+ * \param bandHighFreq Upper frequency of each sub-band, in ascending order
+ * \param numBands Number of sub-bands
+ * \param sampleRate Sample rate of the input signal
+ * \param blockSize Size of the FFT frame, giving blockSize/2 bins
+ */
+void BandMap::initialise(const float *bandHighFreq, int numBands_in,
+                         float sampleRate, int blockSize) {
+  numBands = numBands_in;
+  bandStart.assign(numBands + 1, 0);
+
+  int numBins = blockSize / 2;
+  int currentBand = 0;
+  for (int i = 0; i < numBins; i++) {
+    // find centre frequency of this bin
+    float freq = (i + 1) * sampleRate / (float) blockSize;
+
+    // bins above the last sub-band are added to the last sub-band
+    while (currentBand < numBands - 1 && freq > bandHighFreq[currentBand]) {
+      currentBand++;
+      bandStart[currentBand] = i;
+    }
+  }
+
+  // sub-bands which no bins reached are empty
+  for (int band = currentBand + 1; band <= numBands; band++)
+    bandStart[band] = numBins;
+}
+
+/*!
+ * \brief Returns the number of sub-bands.
+ */
+int BandMap::getNumBands() const {
+  return numBands;
+}
+
+/*!
+ * \brief Returns the first bin in a sub-band.
+ */
+int BandMap::getFirstBin(int band) const {
+  return bandStart[band];
+}
+
+/*!
+ * \brief Returns the bin after the last one in a sub-band.
+ */
+int BandMap::getLastBin(int band) const {
+  return bandStart[band + 1];
+}
+
+/*!
+ * \brief Sums the magnitudes of the bins within each sub-band.
+ *
+ * \param magnitudes Magnitude of each bin
+ * \param bandTotals Sum for each sub-band
+ */
+void BandMap::sumBands(const float *magnitudes, float *bandTotals) const {
+  for (int band = 0; band < numBands; band++) {
+    float total = 0.f;
+    for (int i = bandStart[band]; i < bandStart[band + 1]; i++)
+      total += magnitudes[i];
+    bandTotals[band] = total;
+  }
+}
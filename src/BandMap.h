@@ -0,0 +1,48 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _BAND_MAP_H_
+#define _BAND_MAP_H_
+
+#include <vector>
+
+using std::vector;
+
+/*!
+ * \brief Maps the bins of an FFT frame onto frequency sub-bands
+ *
+ * Each FFT bin is assigned to the first sub-band whose upper frequency is not
+ * below the bin's frequency. As the bins and the sub-bands are both in
+ * ascending order of frequency, each sub-band covers a contiguous range of
+ * bins, so the mapping is stored as the first bin of each sub-band.
+ */
+class BandMap {
+ public:
+  BandMap();
+  void initialise(const float *bandHighFreq, int numBands, float sampleRate,
+                  int blockSize);
+  int getNumBands() const;
+  int getFirstBin(int band) const;
+  int getLastBin(int band) const;
+  void sumBands(const float *magnitudes, float *bandTotals) const;
+
+ protected:
+  int numBands;           /*!< Number of sub-bands */
+  vector<int> bandStart;  /*!< First bin of each sub-band, plus the bin count */
+};
+
+#endif
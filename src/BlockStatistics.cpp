@@ -0,0 +1,345 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "BlockStatistics.h"
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BLOCK_STATISTICS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCK_STATISTICS_SSE2
+#endif
+
+/*!
+ * \brief Updates the statistics with the samples from position 'begin' to
+ * the end of the block, one at a time.
+ *
+ * Each sample is paired with the one after it for counting zero crossings.
+ */
+static void scalarStatistics(const float *buffer, int begin, int length,
+                             int statistics, BlockStatistics &result) {
+  for (int i = begin; i < length; i++) {
+    float x = buffer[i];
+
+    if (statistics & BlockStatistics::SumOfSquares)
+      result.energy += x * x;
+
+    if (statistics & BlockStatistics::Extrema) {
+      if (x < result.min) {
+        result.min = x;
+        result.minPos = i;
+      }
+      if (x > result.max) {
+        result.max = x;
+        result.maxPos = i;
+      }
+    }
+
+    if ((statistics & BlockStatistics::ZeroCrossings) && i + 1 < length) {
+      float y = buffer[i + 1];
+      if ((x < 0 && y > 0) || (x > 0 && y < 0))
+        result.zeroCrossings++;
+    }
+  }
+}
+
+/*!
+ * \brief Merges the per-lane minima and maxima of the vector loop into the
+ * result, preferring the earliest position when values are equal.
+ */
+static void mergeExtrema(const float *minVals, const int *minIdx,
+                         const float *maxVals, const int *maxIdx, int lanes,
+                         BlockStatistics &result) {
+  for (int lane = 0; lane < lanes; lane++) {
+    if (minVals[lane] < result.min
+        || (minVals[lane] == result.min && minIdx[lane] < result.minPos)) {
+      result.min = minVals[lane];
+      result.minPos = minIdx[lane];
+    }
+    if (maxVals[lane] > result.max
+        || (maxVals[lane] == result.max && maxIdx[lane] < result.maxPos)) {
+      result.max = maxVals[lane];
+      result.maxPos = maxIdx[lane];
+    }
+  }
+}
+
+/*!
+ * \brief Returns the number of set bits in a word.
+ */
+static inline int countBits(unsigned long long bits) {
+#if defined(__GNUC__) && defined(__POPCNT__)
+  return __builtin_popcountll(bits);
+#else
+  bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+  bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+  bits = (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((bits * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+#if defined(BLOCK_STATISTICS_AVX2)
+/*!
+ * \brief Packs the top bit of each 32-bit lane of four vectors into a mask of
+ * 32 bits, in sample order.
+ */
+static inline unsigned int packTopBits(__m256i a, __m256i b, __m256i c,
+                                       __m256i d) {
+  // saturating packs keep the sign, but interleave the 128-bit lanes
+  __m256i bytes = _mm256_packs_epi16(_mm256_packs_epi32(a, b),
+                                     _mm256_packs_epi32(c, d));
+  bytes = _mm256_permutevar8x32_epi32(bytes,
+                                      _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+  return (unsigned int) _mm256_movemask_epi8(bytes);
+}
+#elif defined(BLOCK_STATISTICS_SSE2)
+/*!
+ * \brief Packs the top bit of each 32-bit lane of four vectors into a mask of
+ * 16 bits, in sample order.
+ */
+static inline unsigned int packTopBits(__m128i a, __m128i b, __m128i c,
+                                       __m128i d) {
+  // saturating packs keep the sign of each lane
+  __m128i bytes = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+  return (unsigned int) _mm_movemask_epi8(bytes);
+}
+#endif
+
+/*!
+ * \brief Counts the adjacent samples in a block which have opposite signs.
+ *
+ * Samples of zero take neither sign, so a crossing through zero is not
+ * counted, as with calculateBlockStatistics().
+ *
+ * \param buffer Block of samples
+ * \param length Number of samples in the block
+ */
+int countZeroCrossings(const float *buffer, int length) {
+  int count = 0;
+  int i = 0;
+
+#if defined(BLOCK_STATISTICS_AVX2) || defined(BLOCK_STATISTICS_SSE2)
+  // Gather the sign bits of 64 samples at a time into one mask, and whether
+  // each sample is nonzero into another. A crossing is a nonzero sample whose
+  // sign differs from the nonzero sample before it, so each mask is compared
+  // with itself shifted on by a sample, with the last sample of the previous
+  // run carried in.
+  unsigned long long lastSign = 0, lastNonzero = 0;
+  for (; i + 64 <= length; i += 64) {
+    unsigned long long sign = 0, nonzero = 0;
+#if defined(BLOCK_STATISTICS_AVX2)
+    __m256 zero = _mm256_setzero_ps();
+    __m256 magnitude = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    for (int j = 0; j < 64; j += 32) {
+      const float *run = buffer + i + j;
+      __m256 x0 = _mm256_loadu_ps(run);
+      __m256 x1 = _mm256_loadu_ps(run + 8);
+      __m256 x2 = _mm256_loadu_ps(run + 16);
+      __m256 x3 = _mm256_loadu_ps(run + 24);
+      sign |= (unsigned long long) packTopBits(
+          _mm256_castps_si256(x0), _mm256_castps_si256(x1),
+          _mm256_castps_si256(x2), _mm256_castps_si256(x3)) << j;
+      // NaN is unordered, so is never above zero
+      nonzero |= (unsigned long long) packTopBits(
+          _mm256_castps_si256(_mm256_cmp_ps(_mm256_and_ps(x0, magnitude), zero, _CMP_GT_OQ)),
+          _mm256_castps_si256(_mm256_cmp_ps(_mm256_and_ps(x1, magnitude), zero, _CMP_GT_OQ)),
+          _mm256_castps_si256(_mm256_cmp_ps(_mm256_and_ps(x2, magnitude), zero, _CMP_GT_OQ)),
+          _mm256_castps_si256(_mm256_cmp_ps(_mm256_and_ps(x3, magnitude), zero, _CMP_GT_OQ))) << j;
+    }
+#else
+    __m128 zero = _mm_setzero_ps();
+    __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (int j = 0; j < 64; j += 16) {
+      const float *run = buffer + i + j;
+      __m128 x0 = _mm_loadu_ps(run);
+      __m128 x1 = _mm_loadu_ps(run + 4);
+      __m128 x2 = _mm_loadu_ps(run + 8);
+      __m128 x3 = _mm_loadu_ps(run + 12);
+      sign |= (unsigned long long) packTopBits(
+          _mm_castps_si128(x0), _mm_castps_si128(x1),
+          _mm_castps_si128(x2), _mm_castps_si128(x3)) << j;
+      // NaN is unordered, so is never above zero
+      nonzero |= (unsigned long long) packTopBits(
+          _mm_castps_si128(_mm_cmpgt_ps(_mm_and_ps(x0, magnitude), zero)),
+          _mm_castps_si128(_mm_cmpgt_ps(_mm_and_ps(x1, magnitude), zero)),
+          _mm_castps_si128(_mm_cmpgt_ps(_mm_and_ps(x2, magnitude), zero)),
+          _mm_castps_si128(_mm_cmpgt_ps(_mm_and_ps(x3, magnitude), zero))) << j;
+    }
+#endif
+    unsigned long long signBefore = (sign << 1) | lastSign;
+    unsigned long long nonzeroBefore = (nonzero << 1) | lastNonzero;
+    count += countBits((sign ^ signBefore) & nonzero & nonzeroBefore);
+    lastSign = sign >> 63;
+    lastNonzero = nonzero >> 63;
+  }
+#endif
+
+  // finish off the remaining pairs, including the one across the last run
+  for (int k = (i > 0 ? i - 1 : 0); k + 1 < length; k++) {
+    float x = buffer[k];
+    float y = buffer[k + 1];
+    if ((x < 0 && y > 0) || (x > 0 && y < 0))
+      count++;
+  }
+  return count;
+}
+
+/*!
+ * \brief Calculates the requested statistics of a block of samples in a
+ * single pass.
+ *
+ * \param buffer Block of samples
+ * \param length Number of samples in the block
+ * \param statistics Combination of BlockStatistics flags to calculate
+ * \param result Statistics of the block
+ */
+void calculateBlockStatistics(const float *buffer, int length, int statistics,
+                              BlockStatistics &result) {
+  result.energy = 0.f;
+  result.min = std::numeric_limits<float>::infinity();
+  result.minPos = 0;
+  result.max = -std::numeric_limits<float>::infinity();
+  result.maxPos = 0;
+  result.zeroCrossings = 0;
+
+  if (statistics == BlockStatistics::ZeroCrossings) {
+    result.zeroCrossings = countZeroCrossings(buffer, length);
+    return;
+  }
+
+  bool energy = (statistics & BlockStatistics::SumOfSquares) != 0;
+  bool extrema = (statistics & BlockStatistics::Extrema) != 0;
+  bool crossings = (statistics & BlockStatistics::ZeroCrossings) != 0;
+  int i = 0;
+
+  // Each iteration handles a vector of samples, and the pairs of each of
+  // those samples with the sample after it. The loop therefore stops while
+  // there is still one sample beyond the vector, and the rest are left to
+  // the scalar loop.
+#if defined(BLOCK_STATISTICS_AVX2)
+  __m256 zero = _mm256_setzero_ps();
+  __m256 sum = zero;
+  __m256 minVal = _mm256_set1_ps(result.min);
+  __m256 maxVal = _mm256_set1_ps(result.max);
+  __m256i minIdx = _mm256_setzero_si256();
+  __m256i maxIdx = _mm256_setzero_si256();
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i step = _mm256_set1_epi32(8);
+  __m256i count = _mm256_setzero_si256();
+
+  for (; i + 8 < length; i += 8) {
+    __m256 x = _mm256_loadu_ps(buffer + i);
+
+    if (energy)
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(x, x));
+
+    if (extrema) {
+      __m256 lower = _mm256_cmp_ps(x, minVal, _CMP_LT_OQ);
+      __m256 higher = _mm256_cmp_ps(x, maxVal, _CMP_GT_OQ);
+      minVal = _mm256_blendv_ps(minVal, x, lower);
+      maxVal = _mm256_blendv_ps(maxVal, x, higher);
+      minIdx = _mm256_blendv_epi8(minIdx, index, _mm256_castps_si256(lower));
+      maxIdx = _mm256_blendv_epi8(maxIdx, index, _mm256_castps_si256(higher));
+      index = _mm256_add_epi32(index, step);
+    }
+
+    if (crossings) {
+      __m256 y = _mm256_loadu_ps(buffer + i + 1);
+      __m256 upwards = _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_LT_OQ),
+                                     _mm256_cmp_ps(y, zero, _CMP_GT_OQ));
+      __m256 downwards = _mm256_and_ps(_mm256_cmp_ps(x, zero, _CMP_GT_OQ),
+                                       _mm256_cmp_ps(y, zero, _CMP_LT_OQ));
+      // each true lane is -1, so subtracting the mask counts it
+      count = _mm256_sub_epi32(
+          count, _mm256_castps_si256(_mm256_or_ps(upwards, downwards)));
+    }
+  }
+
+  float sumLanes[8], minLanes[8], maxLanes[8];
+  int minIdxLanes[8], maxIdxLanes[8], countLanes[8];
+  _mm256_storeu_ps(sumLanes, sum);
+  _mm256_storeu_ps(minLanes, minVal);
+  _mm256_storeu_ps(maxLanes, maxVal);
+  _mm256_storeu_si256((__m256i *) minIdxLanes, minIdx);
+  _mm256_storeu_si256((__m256i *) maxIdxLanes, maxIdx);
+  _mm256_storeu_si256((__m256i *) countLanes, count);
+  for (int lane = 0; lane < 8; lane++) {
+    result.energy += sumLanes[lane];
+    result.zeroCrossings += countLanes[lane];
+  }
+  mergeExtrema(minLanes, minIdxLanes, maxLanes, maxIdxLanes, 8, result);
+#elif defined(BLOCK_STATISTICS_SSE2)
+  __m128 zero = _mm_setzero_ps();
+  __m128 sum = zero;
+  __m128 minVal = _mm_set1_ps(result.min);
+  __m128 maxVal = _mm_set1_ps(result.max);
+  __m128i minIdx = _mm_setzero_si128();
+  __m128i maxIdx = _mm_setzero_si128();
+  __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+  __m128i step = _mm_set1_epi32(4);
+  __m128i count = _mm_setzero_si128();
+
+  for (; i + 4 < length; i += 4) {
+    __m128 x = _mm_loadu_ps(buffer + i);
+
+    if (energy)
+      sum = _mm_add_ps(sum, _mm_mul_ps(x, x));
+
+    if (extrema) {
+      __m128i lower = _mm_castps_si128(_mm_cmplt_ps(x, minVal));
+      __m128i higher = _mm_castps_si128(_mm_cmpgt_ps(x, maxVal));
+      minVal = _mm_min_ps(x, minVal);
+      maxVal = _mm_max_ps(x, maxVal);
+      minIdx = _mm_or_si128(_mm_and_si128(lower, index),
+                            _mm_andnot_si128(lower, minIdx));
+      maxIdx = _mm_or_si128(_mm_and_si128(higher, index),
+                            _mm_andnot_si128(higher, maxIdx));
+      index = _mm_add_epi32(index, step);
+    }
+
+    if (crossings) {
+      __m128 y = _mm_loadu_ps(buffer + i + 1);
+      __m128 upwards = _mm_and_ps(_mm_cmplt_ps(x, zero), _mm_cmpgt_ps(y, zero));
+      __m128 downwards = _mm_and_ps(_mm_cmpgt_ps(x, zero),
+                                    _mm_cmplt_ps(y, zero));
+      // each true lane is -1, so subtracting the mask counts it
+      count = _mm_sub_epi32(count,
+                            _mm_castps_si128(_mm_or_ps(upwards, downwards)));
+    }
+  }
+
+  float sumLanes[4], minLanes[4], maxLanes[4];
+  int minIdxLanes[4], maxIdxLanes[4], countLanes[4];
+  _mm_storeu_ps(sumLanes, sum);
+  _mm_storeu_ps(minLanes, minVal);
+  _mm_storeu_ps(maxLanes, maxVal);
+  _mm_storeu_si128((__m128i *) minIdxLanes, minIdx);
+  _mm_storeu_si128((__m128i *) maxIdxLanes, maxIdx);
+  _mm_storeu_si128((__m128i *) countLanes, count);
+  for (int lane = 0; lane < 4; lane++) {
+    result.energy += sumLanes[lane];
+    result.zeroCrossings += countLanes[lane];
+  }
+  mergeExtrema(minLanes, minIdxLanes, maxLanes, maxIdxLanes, 4, result);
+#endif
+
+  // finish off the remaining samples
+  scalarStatistics(buffer, i, length, statistics, result);
+}
@@ -0,0 +1,52 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _BLOCK_STATISTICS_H_
+#define _BLOCK_STATISTICS_H_
+
+/*!
+ * \brief Simple statistics of a block of time-domain samples
+ *
+ * The statistics are found in a single pass by calculateBlockStatistics(),
+ * which is vectorised with AVX2 or SSE2 where the compiler targets them, and
+ * falls back to a scalar loop otherwise. Statistics which are not requested
+ * are left at their initial values. When only the zero crossings are
+ * requested, they are counted by countZeroCrossings(), which compares bit
+ * masks of the sample signs rather than pairs of samples.
+ */
+struct BlockStatistics {
+  enum {
+    SumOfSquares = 1,   /*!< Request the energy */
+    Extrema = 2,        /*!< Request the minimum and maximum */
+    ZeroCrossings = 4,  /*!< Request the zero crossing count */
+    All = 7             /*!< Request all of the statistics */
+  };
+
+  float energy;       /*!< Sum of the squared samples */
+  float min;          /*!< Lowest sample value */
+  int minPos;         /*!< Position of the first occurrence of the lowest sample */
+  float max;          /*!< Highest sample value */
+  int maxPos;         /*!< Position of the first occurrence of the highest sample */
+  int zeroCrossings;  /*!< Number of adjacent samples with opposite signs */
+};
+
+void calculateBlockStatistics(const float *buffer, int length, int statistics,
+                              BlockStatistics &result);
+
+int countZeroCrossings(const float *buffer, int length);
+
+#endif
@@ -27,6 +27,12 @@ Energy::Energy(float inputSampleRate):Plugin(inputSampleRate)
   avgWindowLength=1;
   avgPercentile=3;
   dipThresh=3;
+  streaming=false;
+  windowOffsetL=0;
+  windowOffsetR=1;
+  frameCount=0;
+  runningTotal=0;
+  runningLowEnergy=0;
 }
 
 Energy::~Energy()
@@ -160,6 +166,18 @@ Energy::getParameterDescriptors() const
     threshold.isQuantized = false;
     list.push_back(threshold);
 
+    ParameterDescriptor streamingParam;
+    streamingParam.identifier = "streaming";
+    streamingParam.name = "Streaming mode";
+    streamingParam.description = "Return moving average, dip probability and low energy during processing.";
+    streamingParam.unit = "";
+    streamingParam.minValue = 0;
+    streamingParam.maxValue = 1;
+    streamingParam.defaultValue = 0;
+    streamingParam.isQuantized = true;
+    streamingParam.quantizeStep = 1;
+    list.push_back(streamingParam);
+
     return list;
 }
 
@@ -185,6 +203,10 @@ Energy::getParameter(string identifier) const
     {
       return dipThresh;
     }
+    else if (identifier == "streaming")
+    {
+      return streaming;
+    }
 
     return 0;
 }
@@ -214,6 +236,13 @@ Energy::setParameter(string identifier, float value)
     {
       dipThresh = value;
     }
+    else if (identifier == "streaming")
+    {
+      if (value == 1)
+        streaming = true;
+      else
+        streaming = false;
+    }
 }
 
 Energy::ProgramList
@@ -319,6 +348,16 @@ Energy::initialise(size_t channels, size_t stepSize, size_t blockSize)
 
     m_blockSize = blockSize;
     m_stepSize = stepSize;
+
+    // set window size
+    float avgWindowSize = avgWindowLength*sampleRate/(float)m_blockSize;
+    windowOffsetL = (int)floor(avgWindowSize/2.0);
+    windowOffsetR = (int)ceil(avgWindowSize/2.0);
+    if (windowOffsetR < 1) windowOffsetR = 1;
+
+    // allocate the sliding window and its history
+    rmsWindow.initialise(windowOffsetL + windowOffsetR);
+    rmsHistory.assign(windowOffsetL + windowOffsetR, 0.f);
     reset();
 
     return true;
@@ -328,7 +367,11 @@ void
 Energy::reset()
 {
 	rmsEnergy.clear();
+  rmsWindow.clear();
   prevRMS=0;
+  frameCount=0;
+  runningTotal=0;
+  runningLowEnergy=0;
 }
 
 Energy::FeatureSet
@@ -336,21 +379,25 @@ Energy::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
 {
 	FeatureSet output;
 	Feature fRMS, fDelta;
-	float totalEnergy = 0.f;
+	BlockStatistics stats;
 	float rms;
 
   // find total energy for frame
-	for (int i=0; i<m_blockSize; i++)
-	{
-		totalEnergy += inputBuffers[0][i]*inputBuffers[0][i];
-	}
+  calculateBlockStatistics(inputBuffers[0], m_blockSize,
+                           BlockStatistics::SumOfSquares, stats);
+  float totalEnergy = stats.energy;
 
   // apply square root
 	if (useRoot)
 		rms = sqrt(totalEnergy / (float)m_blockSize);
 	else
 		rms = totalEnergy / (float)m_blockSize;
-	rmsEnergy.push_back(rms);
+
+  // keep every value for the end, or only the current window when streaming
+  if (streaming)
+    pushStreamingFrame(rms, output);
+  else
+    rmsEnergy.push_back(rms);
 
   // return RMS and delta
 	fRMS.values.push_back(rms);
@@ -368,14 +415,18 @@ Energy::FeatureSet
 Energy::getRemainingFeatures()
 {
 	FeatureSet output;
-  vector<float> rmsAvg;
 	float total = 0.f, average = 0.f;
 	float lowEnergy = 0.f, highEnergy = 0.f;
 
-  // set window size
-  float avgWindowSize = avgWindowLength*sampleRate/(float)m_blockSize;
-  int avgWindowOffsetL = (int)floor(avgWindowSize/2.0);
-  int avgWindowOffsetR = (int)ceil(avgWindowSize/2.0);
+  if (streaming)
+  {
+    flushStreamingFrames(output);
+    return output;
+  }
+
+  // the window only ever moves forwards, so keep its contents sorted
+  rmsWindow.clear();
+  int windowStart = 0, windowEnd = -1;
 
 	for (unsigned i=0; i<rmsEnergy.size(); i++)
 	{
@@ -383,27 +434,19 @@ Energy::getRemainingFeatures()
 		total += rmsEnergy.at(i);
 
     // get start and end of window
-    int start = i-avgWindowOffsetL;
+    int start = i-windowOffsetL;
     if (start<0) start=0;
-    int end = i+avgWindowOffsetR-1;
+    int end = i+windowOffsetR-1;
     if (end>=rmsEnergy.size()) end = rmsEnergy.size()-1;
 
-    // copy window
-    vector<float>::const_iterator first = rmsEnergy.begin() + start;
-    vector<float>::const_iterator last = rmsEnergy.begin() + end + 1;
-    vector<float> window(first, last);
-
-    // sort window
-    std::sort(window.begin(), window.end());
+    // slide window
+    while (windowStart < start)
+      rmsWindow.remove(rmsEnergy[windowStart++]);
+    while (windowEnd < end)
+      rmsWindow.insert(rmsEnergy[++windowEnd]);
 
-    // find Xth percentile of window
-    int pos = (int)((float)(window.size()-1) / 100.0 * avgPercentile);
-    rmsAvg.push_back(window[pos]);
-
-    // return moving average
-    Feature fAvg;
-    fAvg.values.push_back(rmsAvg[i]);
-    output[3].push_back(fAvg);
+    // return moving average and dip probability
+    pushWindowFeatures(i, output);
 	}
 
   // find mean of all RMS values
@@ -420,26 +463,6 @@ Energy::getRemainingFeatures()
 			lowEnergy++;
 		else
 			highEnergy++;
-
-    // get start and end of window
-    int start = i-avgWindowOffsetL;
-    if (start<0) start=0;
-    int end = i+avgWindowOffsetR-1;
-    if (end>=rmsEnergy.size()) end = rmsEnergy.size()-1;
-
-    // count dips below moving average * dipThresh
-    float dipCount = 0;
-    float threshDip = rmsAvg[i]*dipThresh;
-    for (unsigned int j=start; j<=end; j++)
-    {
-      if (rmsEnergy[j] < threshDip)
-        dipCount++;
-    }
-
-    // return dip probability 
-    Feature fProb;
-    fProb.values.push_back(dipCount/(float)(end-start));
-    output[4].push_back(fProb);
 	}
 
 	// calculate low energy ratio
@@ -458,3 +481,116 @@ Energy::getRemainingFeatures()
 }
 
 /// @endcond
+
+/*!
+ * \brief Finds the moving average and dip probability of a frame from the
+ * values currently held in the sliding window, and adds them to the output.
+ */
+void
+Energy::pushWindowFeatures(int frame, FeatureSet &output)
+{
+  // find Xth percentile of window
+  int pos = (int)((float)(rmsWindow.size()-1) / 100.0 * avgPercentile);
+  float rmsAvg = rmsWindow.at(pos);
+
+  // count dips below moving average * dipThresh
+  float threshDip = rmsAvg*dipThresh;
+  float dipCount = rmsWindow.countBelow(threshDip);
+
+  // return moving average
+  Feature fAvg;
+  fAvg.values.push_back(rmsAvg);
+
+  // return dip probability
+  Feature fProb;
+  fProb.values.push_back(dipCount/(float)(rmsWindow.size()-1));
+
+  // when streaming, features are returned before the end of the block
+  // they belong to, so they need explicit timestamps
+  if (streaming)
+  {
+    fAvg.hasTimestamp = true;
+    fAvg.timestamp = Vamp::RealTime::frame2RealTime(frame*m_stepSize,
+        (unsigned int)sampleRate);
+    fProb.hasTimestamp = true;
+    fProb.timestamp = fAvg.timestamp;
+  }
+
+  output[3].push_back(fAvg);
+  output[4].push_back(fProb);
+}
+
+/*!
+ * \brief Adds the RMS energy of a new frame to the sliding window, and
+ * returns the features of the frame which now has a full window ahead of it.
+ *
+ * Only the values inside the window are kept, in a circular buffer. The low
+ * energy ratio is estimated against the mean RMS energy seen so far,
+ * including this frame, and is returned once per window length.
+ */
+void
+Energy::pushStreamingFrame(float rms, FeatureSet &output)
+{
+  int windowLength = windowOffsetL + windowOffsetR;
+  int slot = frameCount % windowLength;
+
+  // drop the frame which has fallen out of the back of the window
+  if (frameCount >= windowLength)
+    rmsWindow.remove(rmsHistory[slot]);
+  rmsHistory[slot] = rms;
+  rmsWindow.insert(rms);
+  frameCount++;
+
+  // update running low energy count, against a mean which includes this frame
+  runningTotal += rms;
+  if (rms < runningTotal / (float)frameCount * threshRatio)
+    runningLowEnergy++;
+
+  // return the frame at the centre of the window
+  int frame = frameCount - windowOffsetR;
+  if (frame >= 0)
+    pushWindowFeatures(frame, output);
+
+  // return low energy estimate
+  if (frameCount % windowLength == 0)
+    pushLowEnergyEstimate(output);
+}
+
+/*!
+ * \brief Returns the features of the frames at the end of the stream, whose
+ * windows are cut short, and the final low energy estimate.
+ */
+void
+Energy::flushStreamingFrames(FeatureSet &output)
+{
+  int windowLength = windowOffsetL + windowOffsetR;
+  int frame = frameCount - windowOffsetR + 1;
+  if (frame < 0) frame = 0;
+
+  for (; frame < frameCount; frame++)
+  {
+    // shrink the window from the back, as there is nothing left to add
+    int expired = frame - windowOffsetL - 1;
+    if (expired >= 0)
+      rmsWindow.remove(rmsHistory[expired % windowLength]);
+    pushWindowFeatures(frame, output);
+  }
+
+  if (frameCount > 0)
+    pushLowEnergyEstimate(output);
+}
+
+/*!
+ * \brief Returns the running estimate of the low energy ratio, timestamped
+ * at the most recent frame.
+ */
+void
+Energy::pushLowEnergyEstimate(FeatureSet &output)
+{
+	Feature fLowEnergy;
+	fLowEnergy.hasTimestamp = true;
+	fLowEnergy.timestamp = Vamp::RealTime::frame2RealTime(
+      (frameCount-1)*m_stepSize, (unsigned int)sampleRate);
+	fLowEnergy.values.push_back((100.f * runningLowEnergy) / (float)frameCount);
+	output[2].push_back(fLowEnergy);
+}
@@ -22,6 +22,8 @@
 #include <vector>
 #include <algorithm>
 #include <vamp-sdk/Plugin.h>
+#include "OrderStatisticWindow.h"
+#include "BlockStatistics.h"
 
 using std::string;
 using std::vector;
@@ -56,6 +58,9 @@ using std::vector;
  * \par Low energy threshold
  * The threshold for calculating low energy, which is multiplied by the overall
  * mean RMS energy (default = 1.0)
+ * \par Streaming mode
+ * Whether to return the moving average, dip probability and low energy during
+ * processing rather than at the end of the stream. (default = 0)
  *
  * \section Description
  *
@@ -71,6 +76,14 @@ using std::vector;
  * The <b>low energy ratio</b> is the percentage of blocks which fall below
  * a certain RMS energy threshold. The threshold is set using the 'Low energy
  * threshold' parameter which is a ratio of the overall mean RMS energy (default = 1).
+ *
+ * In <b>streaming mode</b>, only the RMS values within the averaging window are
+ * kept. The moving average and dip probability of each block are returned as
+ * soon as half a window of later blocks has been processed, so they arrive
+ * half the window size after the audio. As the overall mean is not known until
+ * the end, each block is instead compared against the mean of the blocks up to
+ * and including it, and an estimate of the low energy ratio is returned once
+ * per window length, and again at the end of the stream.
  */
 class Energy : public Vamp::Plugin
 {
@@ -107,6 +120,11 @@ public:
     /// @endcond
 
 protected:
+    void pushWindowFeatures(int frame, FeatureSet &output);
+    void pushStreamingFrame(float rms, FeatureSet &output);
+    void flushStreamingFrames(FeatureSet &output);
+    void pushLowEnergyEstimate(FeatureSet &output);
+
     /// @cond
     int m_blockSize, m_stepSize;
     /// @endcond
@@ -119,6 +137,14 @@ protected:
     float avgWindowLength; /*!< Length of window to use for averaging, in seconds */
     float avgPercentile; /*!< Percentile to calculate as average. */
     float dipThresh; /*!< Threshold to use for calculating dips, as a multiple of the moving average. */
+    OrderStatisticWindow rmsWindow; /*!< Sorted RMS values within the moving average window */
+    int windowOffsetL; /*!< Number of frames in the window before the current frame */
+    int windowOffsetR; /*!< Number of frames in the window from the current frame onwards */
+    bool streaming; /*!< Flag to indicate whether to return window features during processing */
+    vector<float> rmsHistory; /*!< Circular buffer of RMS values within the window, when streaming */
+    int frameCount; /*!< Number of frames processed */
+    float runningTotal; /*!< Total of RMS values so far, when streaming */
+    float runningLowEnergy; /*!< Number of frames below the running low energy threshold */
 };
 
 
@@ -0,0 +1,115 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _USE_MATH_DEFINES
+
+#include "FourierTransform.h"
+#include <cmath>
+#include <algorithm>
+
+FourierTransform::FourierTransform() {
+  size = 0;
+}
+
+/*!
+ * \brief Prepares the twiddle factors for a transform of the given size,
+ * which must be a power of two.
+ */
+void FourierTransform::initialise(int size_in) {
+  size = size_in;
+  cosTable.resize(size / 2);
+  sinTable.resize(size / 2);
+  for (int i = 0; i < size / 2; i++) {
+    cosTable[i] = cos(2.0 * M_PI * i / size);
+    sinTable[i] = sin(2.0 * M_PI * i / size);
+  }
+}
+
+/*!
+ * \brief Returns the number of points in the transform.
+ */
+int FourierTransform::getSize() const {
+  return size;
+}
+
+/*!
+ * \brief Replaces a complex signal with its discrete Fourier transform.
+ */
+void FourierTransform::forward(double *real, double *imag) const {
+  transform(real, imag, -1.0);
+}
+
+/*!
+ * \brief Replaces a spectrum with its inverse discrete Fourier transform,
+ * scaled by 1/size so that it undoes forward().
+ */
+void FourierTransform::inverse(double *real, double *imag) const {
+  transform(real, imag, 1.0);
+  for (int i = 0; i < size; i++) {
+    real[i] /= size;
+    imag[i] /= size;
+  }
+}
+
+/*!
+ * \brief Returns the smallest power of two which is not less than n.
+ */
+int FourierTransform::nextPowerOfTwo(int n) {
+  int result = 1;
+  while (result < n)
+    result <<= 1;
+  return result;
+}
+
+/*!
+ * \brief Performs an unscaled transform, where the direction is -1 for
+ * forward and 1 for inverse.
+ */
+void FourierTransform::transform(double *real, double *imag,
+                                 double direction) const {
+  // reorder into bit-reversed index order
+  for (int i = 1, j = 0; i < size; i++) {
+    int bit = size >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      std::swap(real[i], real[j]);
+      std::swap(imag[i], imag[j]);
+    }
+  }
+
+  // combine butterflies of increasing length
+  for (int length = 2; length <= size; length <<= 1) {
+    int half = length / 2;
+    int tableStep = size / length;
+    for (int start = 0; start < size; start += length) {
+      for (int k = 0; k < half; k++) {
+        double wr = cosTable[k * tableStep];
+        double wi = direction * sinTable[k * tableStep];
+        int a = start + k;
+        int b = a + half;
+        double tr = real[b] * wr - imag[b] * wi;
+        double ti = real[b] * wi + imag[b] * wr;
+        real[b] = real[a] - tr;
+        imag[b] = imag[a] - ti;
+        real[a] += tr;
+        imag[a] += ti;
+      }
+    }
+  }
+}
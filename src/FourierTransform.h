@@ -0,0 +1,48 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _FOURIER_TRANSFORM_H_
+#define _FOURIER_TRANSFORM_H_
+
+#include <vector>
+
+using std::vector;
+
+/*!
+ * \brief In-place radix-2 complex FFT of a fixed power-of-two size
+ *
+ * The twiddle factors are calculated once by initialise(), so the same
+ * object can be used to transform many frames of the same size.
+ */
+class FourierTransform {
+ public:
+  FourierTransform();
+  void initialise(int size);
+  int getSize() const;
+  void forward(double *real, double *imag) const;
+  void inverse(double *real, double *imag) const;
+  static int nextPowerOfTwo(int n);
+
+ protected:
+  void transform(double *real, double *imag, double direction) const;
+
+  int size;               /*!< Number of points in the transform */
+  vector<double> cosTable; /*!< Cosine of each twiddle factor */
+  vector<double> sinTable; /*!< Sine of each twiddle factor */
+};
+
+#endif
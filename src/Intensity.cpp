@@ -195,6 +195,9 @@ Intensity::initialise(size_t channels, size_t stepSize, size_t blockSize)
 
     m_blockSize = blockSize;
     m_stepSize = stepSize;
+    bandMap.initialise(bandHighFreq, numBands, m_sampleRate, m_blockSize);
+    magnitudes.assign(m_blockSize/2, 0.f);
+    bandTotal.assign(numBands, 0.f);
     reset();
 
     return true;
@@ -208,59 +211,10 @@ Intensity::reset()
 Intensity::FeatureSet
 Intensity::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
 {
-	FeatureSet output;
-	float total = 0;
-	int currentBand = 0;
-	float *bandTotal = new float[numBands];
-
-	// set band totals to zero
-	for (int i=0; i<numBands; i++)
-		bandTotal[i] = 0;
-
-	// for each frequency bin
-	for (int i=0; i<m_blockSize/2; i++)
-	{
-		// get absolute value
-		float binVal = abs(complex<float>(inputBuffers[0][i*2], inputBuffers[0][i*2+1]));
-
-		// add contents of this bin to total
-		total += binVal;
-
-		// find centre frequency of this bin
-		float freq = (i+1)*m_sampleRate / (float)m_blockSize;
+	// get absolute value of each frequency bin
+	calculateMagnitudes(inputBuffers[0], m_blockSize/2, &magnitudes[0]);
 
-		// locate which band this bin belongs in
-		while (freq > bandHighFreq[currentBand]) {
-			currentBand++;
-			if (currentBand >= numBands) break;
-		}
-
-		// add bin value to relevent band
-		bandTotal[currentBand] += binVal;
-	}
-
-	// send intensity outputs
-	Feature intensity;
-	intensity.values.push_back(total);
-	output[0].push_back(intensity);
-
-	// send intensity ratio outputs
-	Feature intensityRatio;
-	for (int i=0; i<numBands; i++)
-	{
-		float bandResult;
-		if (total == 0)
-			bandResult = 0;
-		else
-			bandResult = bandTotal[i] / total;
-		intensityRatio.values.push_back(bandResult);
-	}
-	output[1].push_back(intensityRatio);
-
-	// clean up
-	delete [] bandTotal;
-
-  return output;
+	return processMagnitudes(&magnitudes[0], timestamp);
 }
 
 Intensity::FeatureSet
@@ -288,3 +242,58 @@ Intensity::calculateBandFreqs()
 		bandHighFreq[k] = m_sampleRate / pow(2.f,numBands-k);
 	}
 }
+
+/*!
+ * \brief Calculates the intensity features of a block from the magnitude of
+ * each FFT bin, which may be shared with other plugins.
+ *
+ * \param binMagnitudes Magnitude of each of the blockSize/2 FFT bins
+ * \param timestamp Time of the block
+ */
+Intensity::FeatureSet
+Intensity::processMagnitudes(const float *binMagnitudes, Vamp::RealTime timestamp)
+{
+	FeatureSet output;
+	processMagnitudes(binMagnitudes, timestamp, output);
+	return output;
+}
+
+/*!
+ * \brief Calculates the intensity features of a block from the magnitude of
+ * each FFT bin, and adds them to the lists in output, which may be reused
+ * from block to block.
+ */
+void
+Intensity::processMagnitudes(const float *binMagnitudes, Vamp::RealTime timestamp,
+                             FeatureSet &output)
+{
+	float total = 0;
+
+	// add contents of each bin to total
+	for (int i=0; i<m_blockSize/2; i++)
+	{
+		total += binMagnitudes[i];
+	}
+
+	// add bin values to relevent bands
+	bandMap.sumBands(binMagnitudes, &bandTotal[0]);
+
+	// send intensity outputs
+	Feature intensity;
+	intensity.values.push_back(total);
+	output[0].push_back(intensity);
+
+	// send intensity ratio outputs
+	Feature intensityRatio;
+	intensityRatio.values.reserve(numBands);
+	for (int i=0; i<numBands; i++)
+	{
+		float bandResult;
+		if (total == 0)
+			bandResult = 0;
+		else
+			bandResult = bandTotal[i] / total;
+		intensityRatio.values.push_back(bandResult);
+	}
+	output[1].push_back(intensityRatio);
+}
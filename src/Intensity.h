@@ -22,6 +22,8 @@
 #include <complex>
 #include <vector>
 #include <vamp-sdk/Plugin.h>
+#include "BandMap.h"
+#include "Magnitudes.h"
 
 using std::string;
 using std::vector;
@@ -93,6 +95,10 @@ public:
                        Vamp::RealTime timestamp);
     FeatureSet getRemainingFeatures();
     /// @endcond
+    FeatureSet processMagnitudes(const float *binMagnitudes,
+                                 Vamp::RealTime timestamp);
+    void processMagnitudes(const float *binMagnitudes,
+                           Vamp::RealTime timestamp, FeatureSet &output);
 
 protected:
     void calculateBandFreqs();
@@ -104,6 +110,9 @@ protected:
 
     int numBands;			/*!< Number of sub-bands to use */
     float *bandHighFreq;	/*!< Upper frequency range of each sub-band */
+    BandMap bandMap;		/*!< Range of FFT bins in each sub-band */
+    vector<float> magnitudes;	/*!< Magnitude of each FFT bin in the current block */
+    vector<float> bandTotal;	/*!< Sum of the magnitudes in each sub-band in the current block */
 };
 
 #endif
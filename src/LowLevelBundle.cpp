@@ -0,0 +1,324 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "LowLevelBundle.h"
+/// @cond
+
+LowLevelBundle::LowLevelBundle(float inputSampleRate) :
+    Plugin(inputSampleRate),
+    intensity(inputSampleRate),
+    flux(inputSampleRate),
+    contrast(inputSampleRate),
+    rhythm(inputSampleRate)
+{
+    m_blockSize = 0;
+    m_stepSize = 0;
+    stages[IntensityStage] = &intensity;
+    stages[FluxStage] = &flux;
+    stages[ContrastStage] = &contrast;
+    stages[RhythmStage] = &rhythm;
+    for (int stage = 0; stage < StageCount; stage++) {
+        useStage[stage] = true;
+        outputOffset[stage] = 0;
+    }
+}
+
+LowLevelBundle::~LowLevelBundle()
+{
+}
+
+string
+LowLevelBundle::getIdentifier() const
+{
+    return "bbc-lowlevel-bundle";
+}
+
+string
+LowLevelBundle::getName() const
+{
+    return "Low Level Bundle";
+}
+
+string
+LowLevelBundle::getDescription() const
+{
+    return "Intensity, spectral flux, spectral contrast and rhythm features from a single FFT.";
+}
+
+string
+LowLevelBundle::getMaker() const
+{
+    return "BBC";
+}
+
+int
+LowLevelBundle::getPluginVersion() const
+{
+    return 1;
+}
+
+string
+LowLevelBundle::getCopyright() const
+{
+    return "(c) 2014 British Broadcasting Corporation";
+}
+
+LowLevelBundle::InputDomain
+LowLevelBundle::getInputDomain() const
+{
+    return FrequencyDomain;
+}
+
+size_t
+LowLevelBundle::getPreferredBlockSize() const
+{
+    return rhythm.getPreferredBlockSize();
+}
+
+size_t
+LowLevelBundle::getPreferredStepSize() const
+{
+    return rhythm.getPreferredStepSize();
+}
+
+size_t
+LowLevelBundle::getMinChannelCount() const
+{
+    return 1;
+}
+
+size_t
+LowLevelBundle::getMaxChannelCount() const
+{
+    return 1;
+}
+
+LowLevelBundle::ParameterList
+LowLevelBundle::getParameterDescriptors() const
+{
+    ParameterList list;
+
+    const char *useNames[StageCount] = {
+        "Use intensity", "Use spectral flux", "Use spectral contrast", "Use rhythm"
+    };
+    for (int stage = 0; stage < StageCount; stage++) {
+        ParameterDescriptor use;
+        use.identifier = "use_" + getStagePrefix(stage);
+        use.name = useNames[stage];
+        use.description = "Calculate the features of the " + stages[stage]->getName() + " plugin.";
+        use.unit = "";
+        use.minValue = 0;
+        use.maxValue = 1;
+        use.defaultValue = 1;
+        use.isQuantized = true;
+        use.quantizeStep = 1;
+        list.push_back(use);
+    }
+
+    // pass on the parameters of each stage, under its own prefix
+    for (int stage = 0; stage < StageCount; stage++) {
+        ParameterList stageList = stages[stage]->getParameterDescriptors();
+        for (size_t i = 0; i < stageList.size(); i++) {
+            stageList[i].identifier = getStagePrefix(stage) + "_" + stageList[i].identifier;
+            stageList[i].name = stages[stage]->getName() + ": " + stageList[i].name;
+            list.push_back(stageList[i]);
+        }
+    }
+
+    return list;
+}
+
+float
+LowLevelBundle::getParameter(string identifier) const
+{
+    for (int stage = 0; stage < StageCount; stage++) {
+        string prefix = getStagePrefix(stage);
+        if (identifier == "use_" + prefix)
+            return useStage[stage];
+        if (identifier.compare(0, prefix.size() + 1, prefix + "_") == 0)
+            return stages[stage]->getParameter(identifier.substr(prefix.size() + 1));
+    }
+    return 0;
+}
+
+void
+LowLevelBundle::setParameter(string identifier, float value)
+{
+    for (int stage = 0; stage < StageCount; stage++) {
+        string prefix = getStagePrefix(stage);
+        if (identifier == "use_" + prefix) {
+            useStage[stage] = (value == 1);
+            return;
+        }
+        if (identifier.compare(0, prefix.size() + 1, prefix + "_") == 0) {
+            stages[stage]->setParameter(identifier.substr(prefix.size() + 1), value);
+            return;
+        }
+    }
+}
+
+LowLevelBundle::ProgramList
+LowLevelBundle::getPrograms() const
+{
+    ProgramList list;
+    return list;
+}
+
+string
+LowLevelBundle::getCurrentProgram() const
+{
+    return "";
+}
+
+void
+LowLevelBundle::selectProgram(string name)
+{
+}
+
+LowLevelBundle::OutputList
+LowLevelBundle::getOutputDescriptors() const
+{
+    OutputList list;
+
+    // every stage's outputs are listed, whether or not it is used, so that
+    // the output numbers stay the same
+    for (int stage = 0; stage < StageCount; stage++) {
+        OutputList stageList = stages[stage]->getOutputDescriptors();
+        list.insert(list.end(), stageList.begin(), stageList.end());
+    }
+
+    return list;
+}
+
+bool
+LowLevelBundle::initialise(size_t channels, size_t stepSize, size_t blockSize)
+{
+    if (channels < getMinChannelCount() ||
+        channels > getMaxChannelCount()) return false;
+
+    m_blockSize = blockSize;
+    m_stepSize = stepSize;
+    magnitudes.assign(m_blockSize/2, 0.f);
+
+    int offset = 0;
+    for (int stage = 0; stage < StageCount; stage++) {
+        if (useStage[stage] &&
+            !stages[stage]->initialise(channels, stepSize, blockSize))
+            return false;
+        outputOffset[stage] = offset;
+        int outputs = stages[stage]->getOutputDescriptors().size();
+        offset += outputs;
+
+        // make a list for every output of the stage up front, so that
+        // process() does not add to the map when an output first appears
+        stageOutput[stage].clear();
+        for (int output = 0; output < outputs; output++) {
+            stageOutput[stage][output].clear();
+        }
+    }
+
+    return true;
+}
+
+void
+LowLevelBundle::reset()
+{
+    for (int stage = 0; stage < StageCount; stage++) {
+        if (useStage[stage]) stages[stage]->reset();
+    }
+}
+
+LowLevelBundle::FeatureSet
+LowLevelBundle::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
+{
+    FeatureSet output;
+
+    // find the magnitudes once for every stage
+    calculateMagnitudes(inputBuffers[0], m_blockSize/2, &magnitudes[0]);
+    const float *binMagnitudes = &magnitudes[0];
+
+    for (int stage = 0; stage < StageCount; stage++) {
+        if (!useStage[stage]) continue;
+
+        FeatureSet &stageFeatures = stageOutput[stage];
+        switch (stage) {
+        case IntensityStage:
+            intensity.processMagnitudes(binMagnitudes, timestamp, stageFeatures);
+            break;
+        case FluxStage:
+            flux.processMagnitudes(binMagnitudes, timestamp, stageFeatures);
+            break;
+        case ContrastStage:
+            contrast.processMagnitudes(binMagnitudes, timestamp, stageFeatures);
+            break;
+        case RhythmStage:
+            rhythm.processMagnitudes(binMagnitudes, timestamp, stageFeatures);
+            break;
+        }
+        addStageFeatures(stage, stageFeatures, output);
+    }
+
+    return output;
+}
+
+LowLevelBundle::FeatureSet
+LowLevelBundle::getRemainingFeatures()
+{
+    FeatureSet output;
+
+    for (int stage = 0; stage < StageCount; stage++) {
+        if (!useStage[stage]) continue;
+
+        FeatureSet stageFeatures = stages[stage]->getRemainingFeatures();
+        addStageFeatures(stage, stageFeatures, output);
+    }
+
+    return output;
+}
+
+/// @endcond
+
+/*!
+ * \brief Returns the prefix of the parameters of a stage, such as "rhythm".
+ */
+string
+LowLevelBundle::getStagePrefix(int stage) const
+{
+    switch (stage) {
+    case IntensityStage: return "intensity";
+    case FluxStage: return "flux";
+    case ContrastStage: return "contrast";
+    default: return "rhythm";
+    }
+}
+
+/*!
+ * \brief Moves the features of a stage into the output, renumbering them to
+ * follow the outputs of the stages before it. Outputs with no features are
+ * skipped, and the lists of the stage are left empty, ready for its next
+ * block.
+ */
+void
+LowLevelBundle::addStageFeatures(int stage, FeatureSet &stageFeatures,
+                                 FeatureSet &output)
+{
+    for (FeatureSet::iterator it = stageFeatures.begin();
+         it != stageFeatures.end(); ++it) {
+        if (it->second.empty()) continue;
+        output[outputOffset[stage] + it->first].swap(it->second);
+    }
+}
@@ -0,0 +1,124 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _LOW_LEVEL_BUNDLE_H_
+#define _LOW_LEVEL_BUNDLE_H_
+
+#include <vector>
+#include <vamp-sdk/Plugin.h>
+#include "Intensity.h"
+#include "SpectralFlux.h"
+#include "SpectralContrast.h"
+#include "Rhythm.h"
+#include "Magnitudes.h"
+
+using std::string;
+using std::vector;
+
+/*!
+ * \brief Calculates the intensity, spectral flux, spectral contrast and
+ * rhythm features in a single pass
+ *
+ * \section Outputs
+ * The outputs of the Intensity, Spectral Flux, Spectral Contrast and Rhythm
+ * plugins, in that order and with the same identifiers.
+ *
+ * \section Parameters
+ * \par Use intensity, Use spectral flux, Use spectral contrast, Use rhythm
+ * Whether to calculate the features of each plugin (default = 1)
+ * \par Plugin parameters
+ * The parameters of each plugin, with identifiers prefixed by "intensity_",
+ * "flux_", "contrast_" or "rhythm_", such as "rhythm_numBands".
+ *
+ * \section Description
+ *
+ * Running the four plugins separately means the host calculates an FFT of
+ * each block for each of them, and each plugin then finds the magnitude of
+ * every bin again. This plugin takes one FFT from the host, finds the
+ * magnitudes once, and passes the same buffer to each of the plugins in turn.
+ * The magnitudes are found in the same way as by the separate plugins, so the
+ * outputs are identical to theirs. Each stage adds its features to a feature
+ * set kept for it from block to block, whose lists are then swapped into the
+ * output, so no features are copied.
+ *
+ * Plugins which are not used are neither initialised nor given any blocks, so
+ * cost nothing, although their outputs are still listed, and stay empty, so
+ * that the output numbers do not change.
+ */
+class LowLevelBundle : public Vamp::Plugin
+{
+public:
+    /// @cond
+    LowLevelBundle(float inputSampleRate);
+    virtual ~LowLevelBundle();
+    string getIdentifier() const;
+    string getName() const;
+    string getDescription() const;
+    string getMaker() const;
+    int getPluginVersion() const;
+    string getCopyright() const;
+    InputDomain getInputDomain() const;
+    size_t getPreferredBlockSize() const;
+    size_t getPreferredStepSize() const;
+    size_t getMinChannelCount() const;
+    size_t getMaxChannelCount() const;
+    ParameterList getParameterDescriptors() const;
+    float getParameter(string identifier) const;
+    void setParameter(string identifier,
+                      float value);
+    ProgramList getPrograms() const;
+    string getCurrentProgram() const;
+    void selectProgram(string name);
+    OutputList getOutputDescriptors() const;
+    bool initialise(size_t channels,
+                    size_t stepSize,
+                    size_t blockSize);
+    void reset();
+    FeatureSet process(const float *const *inputBuffers,
+                       Vamp::RealTime timestamp);
+    FeatureSet getRemainingFeatures();
+    /// @endcond
+
+protected:
+    enum {
+        IntensityStage,
+        FluxStage,
+        ContrastStage,
+        RhythmStage,
+        StageCount
+    };
+
+    string getStagePrefix(int stage) const;
+    void addStageFeatures(int stage, FeatureSet &stageFeatures,
+                          FeatureSet &output);
+
+    /// @cond
+    int m_blockSize, m_stepSize;
+    /// @endcond
+
+    Intensity intensity;            /*!< Intensity stage */
+    SpectralFlux flux;              /*!< Spectral flux stage */
+    SpectralContrast contrast;      /*!< Spectral contrast stage */
+    Rhythm rhythm;                  /*!< Rhythm stage */
+    Vamp::Plugin *stages[StageCount];   /*!< Each of the stages, in output order */
+    bool useStage[StageCount];      /*!< Whether to calculate the features of each stage */
+    int outputOffset[StageCount];   /*!< Number of the first output of each stage */
+    vector<float> magnitudes;       /*!< Magnitude of each FFT bin in the current block, shared by every stage */
+    FeatureSet stageOutput[StageCount]; /*!< Features of each stage in the current block, kept so that its lists are reused */
+};
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Magnitudes.h"
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MAGNITUDES_SSE
+#endif
+
+/*!
+ * \brief Calculates the magnitude of each bin of a frequency-domain frame.
+ *
+ * Where SSE is available, the real and imaginary parts of four bins are
+ * deinterleaved and their magnitudes found at a time. The magnitude is taken
+ * as \f$\sqrt{re^2 + im^2}\f$, so may differ in the last place from
+ * std::abs(), which guards against overflow.
+ *
+ * \param frame Interleaved real and imaginary parts of each bin
+ * \param numBins Number of bins in the frame
+ * \param magnitudes Magnitude of each bin
+ */
+void calculateMagnitudes(const float *frame, int numBins, float *magnitudes) {
+  int i = 0;
+
+#if defined(MAGNITUDES_SSE)
+  for (; i + 4 <= numBins; i += 4) {
+    __m128 lo = _mm_loadu_ps(frame + i * 2);
+    __m128 hi = _mm_loadu_ps(frame + i * 2 + 4);
+    __m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+    _mm_storeu_ps(magnitudes + i,
+                  _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re),
+                                         _mm_mul_ps(im, im))));
+  }
+#endif
+
+  // finish off the remaining bins
+  for (; i < numBins; i++) {
+    float re = frame[i * 2];
+    float im = frame[i * 2 + 1];
+    magnitudes[i] = std::sqrt(re * re + im * im);
+  }
+}
@@ -0,0 +1,224 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cassert>
+#include <limits>
+#include "OrderStatisticWindow.h"
+
+// node 0 is the head of the list, and a link to -1 marks the end of a level
+static const int HEAD = 0;
+static const int NIL = -1;
+
+/*!
+ * \brief Returns the value as it is held in the window, where NaN, which
+ * never compares equal to itself, is held as positive infinity.
+ */
+static float canonical(float value) {
+  if (value != value)
+    return std::numeric_limits<float>::infinity();
+  return value;
+}
+
+OrderStatisticWindow::OrderStatisticWindow() {
+  maxLevels = 0;
+  count = 0;
+  seed = 1;
+}
+
+/*!
+ * \brief Allocates enough nodes to hold the given number of values, and
+ * empties the window.
+ */
+void OrderStatisticWindow::initialise(int capacity) {
+  if (capacity < 1)
+    capacity = 1;
+
+  // use enough levels for an expected O(log n) search
+  maxLevels = 1;
+  while ((1 << maxLevels) < capacity && maxLevels < 30)
+    maxLevels++;
+
+  values.assign(capacity + 1, 0.f);
+  levels.assign(capacity + 1, 0);
+  next.assign((capacity + 1) * maxLevels, NIL);
+  width.assign((capacity + 1) * maxLevels, 1);
+  freeNodes.reserve(capacity);
+  chain.assign(maxLevels, HEAD);
+  chainSteps.assign(maxLevels, 0);
+  clear();
+}
+
+/*!
+ * \brief Removes all values from the window without releasing memory.
+ */
+void OrderStatisticWindow::clear() {
+  int capacity = (int) values.size() - 1;
+
+  freeNodes.clear();
+  for (int node = capacity; node > HEAD; node--)
+    freeNodes.push_back(node);
+
+  levels[HEAD] = maxLevels;
+  for (int level = 0; level < maxLevels; level++) {
+    next[HEAD * maxLevels + level] = NIL;
+    width[HEAD * maxLevels + level] = 1;
+  }
+
+  count = 0;
+  seed = 1;
+}
+
+/*!
+ * \brief Adds a value to the window.
+ */
+void OrderStatisticWindow::insert(float value_in) {
+  float value = canonical(value_in);
+
+  // find the last node at each level which is not greater than the value
+  int node = HEAD;
+  int steps = 0;
+  for (int level = maxLevels - 1; level >= 0; level--) {
+    int link = node * maxLevels + level;
+    while (next[link] != NIL && values[next[link]] <= value) {
+      steps += width[link];
+      node = next[link];
+      link = node * maxLevels + level;
+    }
+    chain[level] = node;
+    chainSteps[level] = steps;
+  }
+
+  // take a node from the pool
+  assert(!freeNodes.empty());
+  int newNode = freeNodes.back();
+  freeNodes.pop_back();
+  values[newNode] = value;
+  levels[newNode] = randomLevel();
+
+  // link the new node in, splitting the widths of the links it interrupts
+  for (int level = 0; level < levels[newNode]; level++) {
+    int prevLink = chain[level] * maxLevels + level;
+    int newLink = newNode * maxLevels + level;
+    next[newLink] = next[prevLink];
+    next[prevLink] = newNode;
+    width[newLink] = width[prevLink] - (steps - chainSteps[level]);
+    width[prevLink] = steps - chainSteps[level] + 1;
+  }
+
+  // links which jump over the new node become one element wider
+  for (int level = levels[newNode]; level < maxLevels; level++)
+    width[chain[level] * maxLevels + level]++;
+
+  count++;
+}
+
+/*!
+ * \brief Removes one instance of a value which was previously inserted.
+ */
+void OrderStatisticWindow::remove(float value_in) {
+  float value = canonical(value_in);
+
+  // find the last node at each level which is less than the value
+  int node = HEAD;
+  for (int level = maxLevels - 1; level >= 0; level--) {
+    int link = node * maxLevels + level;
+    while (next[link] != NIL && values[next[link]] < value) {
+      node = next[link];
+      link = node * maxLevels + level;
+    }
+    chain[level] = node;
+  }
+
+  // the first node of this value follows on the bottom level
+  int target = next[chain[0] * maxLevels];
+  assert(target != NIL && values[target] == value);
+  if (target == NIL || values[target] != value)
+    return;
+
+  // unlink the node, merging the widths of the links either side of it
+  for (int level = 0; level < levels[target]; level++) {
+    int prevLink = chain[level] * maxLevels + level;
+    int targetLink = target * maxLevels + level;
+    width[prevLink] += width[targetLink] - 1;
+    next[prevLink] = next[targetLink];
+  }
+
+  // links which jumped over the node become one element narrower
+  for (int level = levels[target]; level < maxLevels; level++)
+    width[chain[level] * maxLevels + level]--;
+
+  freeNodes.push_back(target);
+  count--;
+}
+
+/*!
+ * \brief Returns the value at the given position (starting at 0) when the
+ * window is sorted in ascending order.
+ */
+float OrderStatisticWindow::at(int rank) const {
+  int node = HEAD;
+  int remaining = rank + 1;
+  for (int level = maxLevels - 1; level >= 0; level--) {
+    int link = node * maxLevels + level;
+    while (next[link] != NIL && width[link] <= remaining) {
+      remaining -= width[link];
+      node = next[link];
+      link = node * maxLevels + level;
+    }
+  }
+  return values[node];
+}
+
+/*!
+ * \brief Returns the number of values in the window which are less than the
+ * given value.
+ */
+int OrderStatisticWindow::countBelow(float value) const {
+  int node = HEAD;
+  int rank = 0;
+  for (int level = maxLevels - 1; level >= 0; level--) {
+    int link = node * maxLevels + level;
+    while (next[link] != NIL && values[next[link]] < value) {
+      rank += width[link];
+      node = next[link];
+      link = node * maxLevels + level;
+    }
+  }
+  return rank;
+}
+
+/*!
+ * \brief Returns the number of values held in the window.
+ */
+int OrderStatisticWindow::size() const {
+  return count;
+}
+
+/*!
+ * \brief Picks a level for a new node, where each level is half as likely
+ * as the one below it.
+ */
+int OrderStatisticWindow::randomLevel() {
+  int level = 1;
+  while (level < maxLevels) {
+    seed = seed * 1664525u + 1013904223u;
+    if ((seed >> 16) & 1)
+      break;
+    level++;
+  }
+  return level;
+}
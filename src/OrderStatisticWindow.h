@@ -0,0 +1,65 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _ORDER_STATISTIC_WINDOW_H_
+#define _ORDER_STATISTIC_WINDOW_H_
+
+#include <vector>
+
+using std::vector;
+
+/*!
+ * \brief Sorted multiset of the values inside a sliding window
+ *
+ * Implemented as an indexable skip list, where each link also stores the
+ * number of elements it skips over. This allows insertion, removal,
+ * selection of the nth smallest value and counting of the values below a
+ * threshold in O(log n) time.
+ *
+ * All nodes are allocated from a pool sized by initialise(), so no memory is
+ * allocated while the window slides. The caller is responsible for never
+ * holding more values than the capacity given to initialise(), and for only
+ * removing values which are in the window. NaN values are held as positive
+ * infinity, so they sort after every other value and can be removed again.
+ */
+class OrderStatisticWindow {
+ public:
+  OrderStatisticWindow();
+  void initialise(int capacity);
+  void clear();
+  void insert(float value);
+  void remove(float value);
+  float at(int rank) const;
+  int countBelow(float value) const;
+  int size() const;
+
+ protected:
+  int randomLevel();
+
+  int maxLevels;          /*!< Number of levels in the skip list */
+  int count;              /*!< Number of values currently held */
+  unsigned int seed;      /*!< State of the level generator */
+  vector<float> values;   /*!< Value held by each node */
+  vector<int> levels;     /*!< Number of levels used by each node */
+  vector<int> next;       /*!< Next node for each node and level */
+  vector<int> width;      /*!< Elements skipped by each link */
+  vector<int> freeNodes;  /*!< Stack of unused nodes */
+  vector<int> chain;      /*!< Scratch space for the search path */
+  vector<int> chainSteps; /*!< Scratch space for the search path positions */
+};
+
+#endif
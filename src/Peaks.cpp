@@ -174,22 +174,25 @@ Peaks::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
   int minPoint=0;
   float max=-1.f;
   int maxPoint=0;
-	for (int i=0; i<m_blockSize; i++)
-	{
-    if (inputBuffers[0][i] < min)
-    {
-      min=inputBuffers[0][i];
-      minPoint=i;
-    }
-    else if (inputBuffers[0][i] > max)
-    {
-      max=inputBuffers[0][i];
-      maxPoint=i;
-    }
-	}
+
+  // find lowest and highest samples
+  BlockStatistics stats;
+  calculateBlockStatistics(inputBuffers[0], m_blockSize,
+                           BlockStatistics::Extrema, stats);
+  if (stats.min < min)
+  {
+    min=stats.min;
+    minPoint=stats.minPos;
+  }
+  if (stats.max > max)
+  {
+    max=stats.max;
+    maxPoint=stats.maxPos;
+  }
 
 	FeatureSet output;
 	Feature f;
+  f.values.reserve(2);
   if (minPoint<maxPoint)
   {
     f.values.push_back(min);
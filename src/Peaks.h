@@ -21,6 +21,7 @@
 #include <cmath>
 #include <vector>
 #include <vamp-sdk/Plugin.h>
+#include "BlockStatistics.h"
 
 using std::string;
 using std::vector;
@@ -16,11 +16,20 @@
  * limitations under the License.
  */
 #include "Rhythm.h"
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RHYTHM_SSE
+#endif
+
 /// @cond
 
 Rhythm::Rhythm(float inputSampleRate)
     : Plugin(inputSampleRate) {
   m_sampleRate = inputSampleRate;
+  m_blockSize = getPreferredBlockSize();
+  m_stepSize = getPreferredStepSize();
   numBands = 7;
   bandHighFreq = NULL;
   calculateBandFreqs();
@@ -38,12 +47,28 @@ Rhythm::Rhythm(float inputSampleRate)
   for (int i = cannyLength * -1; i < cannyLength + 1; i++)
     cannyWindow[i + cannyLength] = canny((float) i);
 
+  // combine the two windows, where tap t covers a shift of t - cannyLength
+  // (the last canny co-efficient is never used by the convolution)
+  vector<double> kernel(2 * cannyLength + halfHannLength - 1, 0.0);
+  for (int shift = 0; shift < 2 * cannyLength; shift++)
+    for (int h = 0; h < halfHannLength; h++)
+      kernel[shift + h] += (double) cannyWindow[shift] * halfHannWindow[h];
+  onsetKernel.assign(kernel.begin(), kernel.end());
+
   // set up parameters
   threshold = 1;
   average_window = 200;
   peak_window = 6;
   max_bpm = 300;
   min_bpm = 12;
+  firstShift = 0;
+  lastShift = 0;
+  decimation = 1;
+  tempogram_window = 2048;
+  tempogram_hop = 128;
+  streaming = false;
+  intensityFrames = 0;
+  intensityCapacity = 0;
 }
 
 Rhythm::~Rhythm() {
@@ -170,6 +195,59 @@ Rhythm::ParameterList Rhythm::getParameterDescriptors() const {
   max_bpmParam.quantizeStep = 1.0;
   list.push_back(max_bpmParam);
 
+  ParameterDescriptor decimationParam;
+  decimationParam.identifier = "decimation";
+  decimationParam.name = "Decimation";
+  decimationParam.description =
+      "Factor to decimate the difference curve by before autocorrelation.";
+  decimationParam.unit = "";
+  decimationParam.minValue = 1;
+  decimationParam.maxValue = 8;
+  decimationParam.defaultValue = 1;
+  decimationParam.isQuantized = true;
+  decimationParam.quantizeStep = 1.0;
+  list.push_back(decimationParam);
+
+  ParameterDescriptor tempogram_windowParam;
+  tempogram_windowParam.identifier = "tempogram_window";
+  tempogram_windowParam.name = "Tempogram window length";
+  tempogram_windowParam.description =
+      "Length of window used for each frame of the tempogram.";
+  tempogram_windowParam.unit = "frames";
+  tempogram_windowParam.minValue = 64;
+  tempogram_windowParam.maxValue = 16384;
+  tempogram_windowParam.defaultValue = 2048;
+  tempogram_windowParam.isQuantized = true;
+  tempogram_windowParam.quantizeStep = 1.0;
+  list.push_back(tempogram_windowParam);
+
+  ParameterDescriptor tempogram_hopParam;
+  tempogram_hopParam.identifier = "tempogram_hop";
+  tempogram_hopParam.name = "Tempogram hop";
+  tempogram_hopParam.description =
+      "Number of frames between the start of each tempogram window, or 0 "
+      "for no tempogram.";
+  tempogram_hopParam.unit = "frames";
+  tempogram_hopParam.minValue = 0;
+  tempogram_hopParam.maxValue = 4096;
+  tempogram_hopParam.defaultValue = 128;
+  tempogram_hopParam.isQuantized = true;
+  tempogram_hopParam.quantizeStep = 1.0;
+  list.push_back(tempogram_hopParam);
+
+  ParameterDescriptor streamingParam;
+  streamingParam.identifier = "streaming";
+  streamingParam.name = "Streaming mode";
+  streamingParam.description =
+      "Return onset curve, average, difference and onsets during processing.";
+  streamingParam.unit = "";
+  streamingParam.minValue = 0;
+  streamingParam.maxValue = 1;
+  streamingParam.defaultValue = 0;
+  streamingParam.isQuantized = true;
+  streamingParam.quantizeStep = 1.0;
+  list.push_back(streamingParam);
+
   return list;
 }
 
@@ -186,6 +264,14 @@ float Rhythm::getParameter(string identifier) const {
     return min_bpm;
   else if (identifier == "max_bpm")
     return max_bpm;
+  else if (identifier == "decimation")
+    return decimation;
+  else if (identifier == "tempogram_window")
+    return tempogram_window;
+  else if (identifier == "tempogram_hop")
+    return tempogram_hop;
+  else if (identifier == "streaming")
+    return streaming ? 1 : 0;
   return 0;
 }
 
@@ -203,6 +289,14 @@ void Rhythm::setParameter(string identifier, float value) {
     min_bpm = (int) value;
   } else if (identifier == "max_bpm") {
     max_bpm = (int) value;
+  } else if (identifier == "decimation") {
+    decimation = (int) value;
+  } else if (identifier == "tempogram_window") {
+    tempogram_window = (int) value;
+  } else if (identifier == "tempogram_hop") {
+    tempogram_hop = (int) value;
+  } else if (identifier == "streaming") {
+    streaming = (value > 0.5);
   }
 }
 
@@ -361,6 +455,39 @@ Rhythm::OutputList Rhythm::getOutputDescriptors() const {
   tempo.hasDuration = false;
   list.push_back(tempo);
 
+  OutputDescriptor tempogramOutput;
+  tempogramOutput.identifier = "tempogram";
+  tempogramOutput.name = "Tempogram";
+  tempogramOutput.description =
+      "Autocorrelation of onset detection curve over a sliding window.";
+  tempogramOutput.unit = "";
+  tempogramOutput.hasFixedBinCount = true;
+  tempogramOutput.binCount = std::max(delayInFrames(min_bpm)
+                                      - delayInFrames(max_bpm), 0);
+  tempogramOutput.hasKnownExtents = false;
+  tempogramOutput.isQuantized = false;
+  tempogramOutput.sampleType = OutputDescriptor::VariableSampleRate;
+  tempogramOutput.sampleRate = 0;
+  tempogramOutput.hasDuration = false;
+
+  OutputDescriptor local_tempo;
+  local_tempo.identifier = "local-tempo";
+  local_tempo.name = "Local Tempo";
+  local_tempo.description = "Tempo of each tempogram window in BPM.";
+  local_tempo.unit = "bpm";
+  local_tempo.hasFixedBinCount = true;
+  local_tempo.binCount = 1;
+  local_tempo.hasKnownExtents = false;
+  local_tempo.isQuantized = false;
+  local_tempo.sampleType = OutputDescriptor::VariableSampleRate;
+  local_tempo.sampleRate = 0;
+  local_tempo.hasDuration = false;
+
+  if (tempogram_hop > 0) {
+    list.push_back(tempogramOutput);
+    list.push_back(local_tempo);
+  }
+
   return list;
 }
 
@@ -370,6 +497,27 @@ bool Rhythm::initialise(size_t channels, size_t stepSize, size_t blockSize) {
 
   m_blockSize = blockSize;
   m_stepSize = stepSize;
+  bandMap.initialise(bandHighFreq, numBands, m_sampleRate, m_blockSize);
+  magnitudes.assign(m_blockSize / 2, 0.f);
+  bandTotal.assign(numBands, 0.f);
+
+  // find shift range for autocor
+  firstShift = delayInFrames(max_bpm);
+  lastShift = delayInFrames(min_bpm);
+  if (tempogram_hop > 0)
+    tempogram.initialise(tempogram_hop, tempogram_window, firstShift,
+                         lastShift);
+
+  // make room for the peaks of a tempogram window, so that streaming does
+  // not allocate once it has started
+  int shifts = std::max(lastShift - firstShift, 0);
+  windowAutocor.reserve(shifts);
+  windowPeaks.reserve(shifts);
+  windowValleys.reserve(shifts);
+  selectScratch.reserve(shifts);
+  maximaScratch.reserve(shifts);
+  localMaximum.initialise(shifts);
+
   reset();
 
   return true;
@@ -377,191 +525,215 @@ bool Rhythm::initialise(size_t channels, size_t stepSize, size_t blockSize) {
 
 void Rhythm::reset() {
   intensity.clear();
+  intensityFrames = 0;
+  intensityCapacity = 0;
+
+  // size each history to hold the blocks its stage looks back over
+  streamFrames = 0;
+  envelopeFrames = 0;
+  onsetFrames = 0;
+  averageFrames = 0;
+  averageEntered = 0;
+  peakFrames = 0;
+  peakEntered = 0;
+  streamOnsets = 0;
+  streamOnsetTotal = 0;
+  onsetMean = 0;
+  onsetVariance = 0;
+  averageTotal = 0;
+  tempogram.reset();
+  if (streaming) {
+    totalHistory.assign(halfHannLength, 0.f);
+    envelopeHistory.assign(cannyLength * 2 + 2, 0.f);
+    onsetHistory.assign(average_window * 2 + peak_window + 4, 0.f);
+    normHistory.assign(average_window * 2 + peak_window + 4, 0.f);
+    diffHistory.assign(std::max(lastShift, peak_window * 2 + 2) + 2, 0.f);
+    autocorTotal.assign(std::max(lastShift - firstShift, 0), 0.0);
+    peakMaximum.initialise(peak_window * 2 + 2);
+  }
 }
 
 Rhythm::FeatureSet Rhythm::process(const float * const *inputBuffers,
                                    Vamp::RealTime timestamp) {
-  FeatureSet output;
-  float total = 0;
-  int currentBand = 0;
-  vector<float> bandTotal;
-
-  // set band totals to zero
-  for (int i = 0; i < numBands; i++)
-    bandTotal.push_back(0.f);
-
-  // for each frequency bin
-  for (int i = 0; i < m_blockSize / 2; i++) {
-    // get absolute value
-    float binVal = abs(
-        complex<float>(inputBuffers[0][i * 2], inputBuffers[0][i * 2 + 1]));
-
-    // add contents of this bin to total
-    total += binVal;
-
-    // find centre frequency of this bin
-    float freq = (i + 1) * m_sampleRate / (float) m_blockSize;
-
-    // locate which band this bin belongs in
-    while (freq > bandHighFreq[currentBand]) {
-      currentBand++;
-      if (currentBand >= numBands)
-        break;
-    }
+  // get absolute value of each frequency bin
+  calculateMagnitudes(inputBuffers[0], m_blockSize / 2, &magnitudes[0]);
 
-    // add bin value to relevent band
-    bandTotal.at(currentBand) += binVal;
-  }
-
-  intensity.push_back(bandTotal);
-
-  return output;
+  return processMagnitudes(&magnitudes[0], timestamp);
 }
 
 Rhythm::FeatureSet Rhythm::getRemainingFeatures() {
   FeatureSet output;
-  int frames = intensity.size();
+  int frames = intensityFrames;
+
+  if (streaming) {
+    if (streamFrames == 0)
+      return output;
+    advanceStream(true, output);
+    if (tempogram_hop > 0) {
+      tempogram.finish();
+      pushTempogramFeatures(output);
+    }
 
-  if (frames == 0)
+    vector<float> autocor;
+    for (unsigned i = 0; i < autocorTotal.size(); i++)
+      autocor.push_back(autocorTotal[i] / streamFrames);
+    vector<int>& autocorPeaks = windowPeaks;
+    vector<int>& autocorValleys = windowValleys;
+    autocorPeaks.clear();
+    autocorValleys.clear();
+    findCorrelationPeaks(autocor, 95, 3, firstShift, autocorPeaks,
+                         autocorValleys);
+    pushSummaryFeatures(streamFrames, streamOnsets,
+                        streamOnsetTotal / streamOnsets, autocor,
+                        autocorPeaks, autocorValleys, output);
     return output;
+  }
 
-  // find envelope by convolving each subband with half-hanning window
-  vector<vector<float> > envelope;
-  halfHannConvolve(envelope);
+  if (frames == 0)
+    return output;
 
-  // find onset curve by convolving each subband of envelope with canny window
-  vector<float> onset;
-  cannyConvolve(envelope, onset);
+  // once summed, the intensity of each subband is no longer needed, so its
+  // buffer holds each curve in turn, with room for one block per frame
+  if (numBands < 4)
+    intensity.resize(4 * intensityCapacity);
+  float *total = &intensity[0];
+  float *onset = total + intensityCapacity;
+  float *onsetNorm = onset + intensityCapacity;
+  float *onsetDiff = onsetNorm + intensityCapacity;
+  float *onsetAverage = total;
+
+  // find onset curve by convolving the sum of the subbands with the
+  // half-hanning and canny windows
+  sumIntensity(total);
+  onsetConvolve(total, frames, onset);
 
   // normalise onset curve
-  vector<float> onsetNorm;
-  normalise(onset, onsetNorm);
+  normalise(onset, frames, onsetNorm);
 
   // push normalised onset curve
   Feature f_onset;
   f_onset.hasTimestamp = true;
-  for (unsigned i = 0; i < onsetNorm.size(); i++) {
+  output[0].reserve(frames);
+  for (int i = 0; i < frames; i++) {
     f_onset.timestamp = Vamp::RealTime::frame2RealTime(i * m_stepSize,
                                                        m_sampleRate);
     f_onset.values.clear();
-    f_onset.values.push_back(onsetNorm.at(i));
+    f_onset.values.push_back(onsetNorm[i]);
     output[0].push_back(f_onset);
   }
 
   // find moving average of onset curve and difference
-  vector<float> onsetAverage;
-  vector<float> onsetDiff;
-  movingAverage(onsetNorm, average_window, threshold, onsetAverage, onsetDiff);
+  movingAverage(onsetNorm, frames, average_window, threshold, onsetAverage,
+                onsetDiff);
 
   // push moving average
   Feature f_avg;
   f_avg.hasTimestamp = true;
-  for (unsigned i = 0; i < onsetAverage.size(); i++) {
+  output[1].reserve(frames);
+  for (int i = 0; i < frames; i++) {
     f_avg.timestamp = Vamp::RealTime::frame2RealTime(i * m_stepSize,
                                                      m_sampleRate);
     f_avg.values.clear();
-    f_avg.values.push_back(onsetAverage.at(i));
+    f_avg.values.push_back(onsetAverage[i]);
     output[1].push_back(f_avg);
   }
 
   // push difference from average
   Feature f_diff;
   f_diff.hasTimestamp = true;
-  for (unsigned i = 0; i < onsetDiff.size(); i++) {
+  output[2].reserve(frames);
+  for (int i = 0; i < frames; i++) {
     f_diff.timestamp = Vamp::RealTime::frame2RealTime(i * m_stepSize,
                                                       m_sampleRate);
     f_diff.values.clear();
-    f_diff.values.push_back(onsetDiff.at(i));
+    f_diff.values.push_back(onsetDiff[i]);
     output[2].push_back(f_diff);
   }
 
   // choose peaks
   vector<int> peaks;
-  findOnsetPeaks(onsetDiff, peak_window, peaks);
+  findOnsetPeaks(onsetDiff, frames, peak_window, peaks);
   int onsetCount = (int) peaks.size();
 
   // push peaks
   Feature f_peak;
   f_peak.hasTimestamp = true;
   for (unsigned i = 0; i < peaks.size(); i++) {
-    f_peak.timestamp = Vamp::RealTime::frame2RealTime(peaks.at(i) * m_stepSize,
+    f_peak.timestamp = Vamp::RealTime::frame2RealTime(peaks[i] * m_stepSize,
                                                       m_sampleRate);
     output[3].push_back(f_peak);
   }
 
-  // calculate average onset frequency
-  float averageOnsetFreq = (float) onsetCount
-      / (float) (frames * m_stepSize / m_sampleRate);
-  Feature f_avgOnsetFreq;
-  f_avgOnsetFreq.hasTimestamp = true;
-  f_avgOnsetFreq.timestamp = Vamp::RealTime::fromSeconds(0.0);
-  f_avgOnsetFreq.values.push_back(averageOnsetFreq);
-  output[4].push_back(f_avgOnsetFreq);
-
   // calculate rhythm strength
   float rhythmStrength = findMeanPeak(onset, peaks, 0);
-  Feature f_rhythmStrength;
-  f_rhythmStrength.hasTimestamp = true;
-  f_rhythmStrength.timestamp = Vamp::RealTime::fromSeconds(0.0);
-  f_rhythmStrength.values.push_back(rhythmStrength);
-  output[5].push_back(f_rhythmStrength);
-
-  // find shift range for autocor
-  float firstShift = (int) round(60.f / max_bpm * m_sampleRate / m_stepSize);
-  float lastShift = (int) round(60.f / min_bpm * m_sampleRate / m_stepSize);
 
-  // autocorrelation
+  // autocorrelation and its peaks, from the decimated signal if requested
   vector<float> autocor;
-  autocorrelation(onsetDiff, firstShift, lastShift, autocor);
-  Feature f_autoCor;
-  f_autoCor.hasTimestamp = true;
-  for (float shift = firstShift; shift < lastShift; shift++) {
-    f_autoCor.timestamp = Vamp::RealTime::frame2RealTime(shift * m_stepSize,
-                                                         m_sampleRate);
-    f_autoCor.values.clear();
-    f_autoCor.values.push_back(autocor.at(shift - firstShift));
-    output[6].push_back(f_autoCor);
-  }
-
-  // find peaks in autocor
-  float percentile = 95;
-  int autocorWindowLength = 3;
   vector<int> autocorPeaks;
   vector<int> autocorValleys;
-  findCorrelationPeaks(autocor, percentile, autocorWindowLength, firstShift,
-                       autocorPeaks, autocorValleys);
-
-  // find average corrolation peak
-  float meanCorrelationPeak = findMeanPeak(autocor, autocorPeaks, firstShift);
-  Feature f_meanCorrelationPeak;
-  f_meanCorrelationPeak.hasTimestamp = true;
-  f_meanCorrelationPeak.timestamp = Vamp::RealTime::fromSeconds(0.0);
-  f_meanCorrelationPeak.values.push_back(meanCorrelationPeak);
-  output[7].push_back(f_meanCorrelationPeak);
+  if (decimation > 1) {
+    decimatedAutocorrelation(onsetDiff, frames, autocor, autocorPeaks,
+                             autocorValleys);
+  } else {
+    autocorrelation(onsetDiff, frames, firstShift, lastShift, autocor);
+    findCorrelationPeaks(autocor, 95, 3, firstShift, autocorPeaks,
+                         autocorValleys);
+  }
 
-  // find peak/valley ratio
-  float meanCorrelationValley = findMeanPeak(autocor, autocorValleys,
-                                             firstShift) + 0.0001;
-  Feature f_peakValleyRatio;
-  f_peakValleyRatio.hasTimestamp = true;
-  f_peakValleyRatio.timestamp = Vamp::RealTime::fromSeconds(0.0);
-  f_peakValleyRatio.values.push_back(
-      meanCorrelationPeak / meanCorrelationValley);
-  output[8].push_back(f_peakValleyRatio);
+  // autocorrelation over time
+  if (tempogram_hop > 0) {
+    for (int i = 0; i < frames; i++)
+      tempogram.push(onsetDiff[i]);
+    tempogram.finish();
+    pushTempogramFeatures(output);
+  }
 
-  // find tempo from peaks
-  float tempo = findTempo(autocorPeaks);
-  Feature f_tempo;
-  f_tempo.hasTimestamp = true;
-  f_tempo.timestamp = Vamp::RealTime::fromSeconds(0.0);
-  f_tempo.values.push_back(tempo);
-  output[9].push_back(f_tempo);
+  pushSummaryFeatures(frames, onsetCount, rhythmStrength, autocor,
+                      autocorPeaks, autocorValleys, output);
 
   return output;
 }
 
 /// @endcond
 
+/*!
+ * \brief Adds a block to the intensity curve from the magnitude of each FFT
+ * bin, which may be shared with other plugins.
+ *
+ * \param magnitudes_in Magnitude of each of the blockSize/2 FFT bins
+ * \param timestamp Time of the block
+ */
+Rhythm::FeatureSet Rhythm::processMagnitudes(const float *magnitudes_in,
+                                             Vamp::RealTime timestamp) {
+  FeatureSet output;
+  processMagnitudes(magnitudes_in, timestamp, output);
+  return output;
+}
+
+/*!
+ * \brief Processes a block from the magnitude of each FFT bin, and adds any
+ * features which become known to the lists in output_out, which may be
+ * reused from block to block.
+ */
+void Rhythm::processMagnitudes(const float *magnitudes_in,
+                               Vamp::RealTime timestamp,
+                               FeatureSet& output_out) {
+  // add bin values to relevent bands
+  bandMap.sumBands(magnitudes_in, &bandTotal[0]);
+
+  // keep every block for the end, or only the recent ones when streaming
+  if (streaming) {
+    float total = 0;
+    for (int subBand = 0; subBand < numBands; subBand++)
+      total += bandTotal[subBand];
+    totalHistory[streamFrames % halfHannLength] = total;
+    streamFrames++;
+    advanceStream(false, output_out);
+  } else {
+    appendIntensity(bandTotal);
+  }
+}
+
 void Rhythm::calculateBandFreqs() {
   delete[] bandHighFreq;
   bandHighFreq = new float[numBands];
@@ -581,192 +753,729 @@ float Rhythm::canny(float n) {
       * exp(-1 * (n * n) / (2 * cannyShape * cannyShape));
 }
 
-float Rhythm::findRemainder(vector<int> peaks, int thisPeak) {
+float Rhythm::findRemainder(const vector<int>& peaks, int thisPeak) {
   float total = 0;
   for (unsigned i = 0; i < peaks.size(); i++) {
-    float ratio = (float) peaks.at(i) / (float) thisPeak;
+    float ratio = (float) peaks[i] / (float) thisPeak;
     total += abs(ratio - round(ratio));
   }
   return total;
 }
 
-float Rhythm::findTempo(vector<int> peaks) {
+float Rhythm::findTempo(const vector<int>& peaks) {
   if (peaks.empty()) return 0.f;
-  float min = findRemainder(peaks, peaks.at(0));
+  float min = findRemainder(peaks, peaks[0]);
   int minPos = 0;
   for (unsigned i = 1; i < peaks.size(); i++) {
-    float result = findRemainder(peaks, peaks.at(i));
+    float result = findRemainder(peaks, peaks[i]);
     if (result < min) {
       min = result;
       minPos = i;
     }
   }
-  return 60.f / (peaks.at(minPos) * m_stepSize / m_sampleRate);
+  return 60.f / (peaks[minPos] * m_stepSize / m_sampleRate);
 }
 
-float Rhythm::findMeanPeak(vector<float> signal, vector<int> peaks, int shift) {
+float Rhythm::findMeanPeak(const float *signal, const vector<int>& peaks,
+                           int shift) {
   float total = 0;
   for (unsigned i = 0; i < peaks.size(); i++)
-    total += signal.at(peaks.at(i) - shift);
+    total += signal[peaks[i] - shift];
   return total / peaks.size();
 }
 
-void Rhythm::findCorrelationPeaks(vector<float> autocor_in, float percentile_in,
-                                  int windowLength_in, int shift_in,
-                                  vector<int>& peaks_out,
+void Rhythm::findCorrelationPeaks(const vector<float>& autocor_in,
+                                  float percentile_in, int windowLength_in,
+                                  int shift_in, vector<int>& peaks_out,
                                   vector<int>& valleys_out) {
   if (autocor_in.empty()) return;
 
-  vector<float> autocorSorted(autocor_in);
-  std::sort(autocorSorted.begin(), autocorSorted.end());
-  float autocorThreshold = autocorSorted.at(
-      percentile_in / 100.f * (autocorSorted.size() - 1));
+  // select the percentile without sorting the whole autocorrelation
+  vector<float>& autocorSelect = selectScratch;
+  autocorSelect.assign(autocor_in.begin(), autocor_in.end());
+  int thresholdPos = percentile_in / 100.f * (autocorSelect.size() - 1);
+  std::nth_element(autocorSelect.begin(), autocorSelect.begin() + thresholdPos,
+                   autocorSelect.end());
+  float autocorThreshold = autocorSelect[thresholdPos];
+
+  // find candidate peaks
+  vector<int>& maxima = maximaScratch;
+  maxima.clear();
+  findLocalMaxima(&autocor_in[0], autocor_in.size(), windowLength_in, maxima);
+  unsigned nextMaximum = 0;
 
   int autocorValleyPos = 0;
   float autocorValleyValue = autocorThreshold;
 
   for (unsigned i = 0; i < autocor_in.size(); i++) {
-    bool success = true;
-
     // check for valley
-    if (autocor_in.at(i) < autocorValleyValue) {
+    if (autocor_in[i] < autocorValleyValue) {
       autocorValleyPos = i;
-      autocorValleyValue = autocor_in.at(i);
+      autocorValleyValue = autocor_in[i];
+    }
+
+    // check whether this is the maximum of its window
+    bool success = false;
+    if (nextMaximum < maxima.size() && maxima[nextMaximum] == (int) i) {
+      success = true;
+      nextMaximum++;
     }
 
     // if below the threshold, move onto next element
-    if (autocor_in.at(i) < autocorThreshold)
+    if (autocor_in[i] < autocorThreshold)
       continue;
 
-    // check for other peaks in the area
-    for (int j = windowLength_in * -1; j < windowLength_in + 1; j++) {
-      if (i + j >= 0 && i + j < autocor_in.size()) {
-        if (autocor_in.at(i + j) > autocor_in.at(i))
-          success = false;
-      }
-    }
-
     // save peak and valley
     if (success) {
       peaks_out.push_back(shift_in + i);
       valleys_out.push_back(shift_in + autocorValleyPos);
-      autocorValleyValue = autocor_in.at(i);
+      autocorValleyValue = autocor_in[i];
     }
   }
 }
 
-void Rhythm::autocorrelation(vector<float> signal_in, int startShift_in,
-                             int endShift_in, vector<float>& autocor_out) {
-  for (float shift = startShift_in; shift < endShift_in; shift++) {
+void Rhythm::autocorrelation(const float *signal_in, int length_in,
+                             int startShift_in, int endShift_in,
+                             vector<float>& autocor_out) {
+  if (endShift_in <= startShift_in)
+    return;
+
+  // estimate the cost of each method, and use the cheapest
+  int length = length_in;
+  int fftSize = FourierTransform::nextPowerOfTwo(length + endShift_in);
+  double directCost = (double) length * (endShift_in - startShift_in);
+  double fftCost = 4.0 * fftSize * log((double) fftSize) / log(2.0);
+
+  if (directCost > fftCost)
+    fftAutocorrelation(signal_in, length_in, startShift_in, endShift_in,
+                       autocor_out);
+  else
+    directAutocorrelation(signal_in, length_in, startShift_in, endShift_in,
+                          autocor_out);
+}
+
+void Rhythm::directAutocorrelation(const float *signal_in, int length_in,
+                                   int startShift_in, int endShift_in,
+                                   vector<float>& autocor_out) {
+  int length = length_in;
+  const float *signal = signal_in;
+  for (int shift = startShift_in; shift < endShift_in; shift++) {
     float result = 0;
-    for (unsigned frame = 0; frame < signal_in.size(); frame++) {
-      if (frame + shift < signal_in.size())
-        result += signal_in.at(frame) * signal_in.at(frame + shift);
-    }
-    autocor_out.push_back(result / signal_in.size());
+    for (int frame = 0; frame + shift < length; frame++)
+      result += signal[frame] * signal[frame + shift];
+    autocor_out.push_back(result / length);
   }
 }
 
-void Rhythm::findOnsetPeaks(vector<float> onset_in, int windowLength_in,
-                            vector<int>& peaks_out) {
-  for (unsigned frame = 0; frame < onset_in.size(); frame++) {
-    bool success = true;
+void Rhythm::fftAutocorrelation(const float *signal_in, int length_in,
+                                int startShift_in, int endShift_in,
+                                vector<float>& autocor_out) {
+  // pad with enough zeros that the correlation doesn't wrap around
+  int length = length_in;
+  FourierTransform fft;
+  fft.initialise(FourierTransform::nextPowerOfTwo(length + endShift_in));
+  vector<double> real(fft.getSize(), 0.0);
+  vector<double> imag(fft.getSize(), 0.0);
+  for (int frame = 0; frame < length; frame++)
+    real[frame] = signal_in[frame];
+
+  // the inverse transform of the power spectrum is the autocorrelation
+  fft.forward(&real[0], &imag[0]);
+  for (int i = 0; i < fft.getSize(); i++) {
+    real[i] = real[i] * real[i] + imag[i] * imag[i];
+    imag[i] = 0.0;
+  }
+  fft.inverse(&real[0], &imag[0]);
 
-    // ignore 0 values
-    if (onset_in.at(frame) <= 0)
-      continue;
+  for (int shift = startShift_in; shift < endShift_in; shift++) {
+    if (shift < length)
+      autocor_out.push_back(real[shift] / length);
+    else
+      autocor_out.push_back(0.f);
+  }
+}
 
-    // if any frames within windowSize have a bigger value, this is not the peak
-    for (int i = windowLength_in * -1; i < windowLength_in + 1; i++) {
-      if (frame + i >= 0 && frame + i < onset_in.size()) {
-        if (onset_in.at(frame + i) > onset_in.at(frame))
-          success = false;
-      }
-    }
+void Rhythm::findOnsetPeaks(const float *onset_in, int length_in,
+                            int windowLength_in, vector<int>& peaks_out) {
+  // find frames which are the maximum within windowSize
+  vector<int>& maxima = maximaScratch;
+  maxima.clear();
+  findLocalMaxima(onset_in, length_in, windowLength_in, maxima);
+
+  // ignore 0 values and push result out
+  for (unsigned i = 0; i < maxima.size(); i++) {
+    if (onset_in[maxima[i]] > 0)
+      peaks_out.push_back(maxima[i]);
+  }
+}
 
-    // push result out
-    if (success) {
-      peaks_out.push_back(frame);
-    }
+/*!
+ * \brief Finds the frames whose value is not exceeded by any other frame
+ * within windowLength_in frames either side of it.
+ *
+ * The maximum of the window is tracked with a SlidingMaximum as it moves
+ * along the signal, so this takes linear time regardless of the window
+ * length.
+ */
+void Rhythm::findLocalMaxima(const float *signal_in, int length_in,
+                             int windowLength_in, vector<int>& maxima_out) {
+  int length = length_in;
+
+  // the window holds the frame leaving it as the next one enters, and never
+  // more than the whole signal
+  localMaximum.initialise(std::min(windowLength_in * 2 + 2, length));
+  int entering = 0;
+
+  for (int frame = 0; frame < length; frame++) {
+    // extend the window forwards, and drop frames which have left the back
+    for (; entering < length && entering <= frame + windowLength_in;
+        entering++)
+      localMaximum.push(entering, signal_in[entering]);
+    localMaximum.dropBefore(frame - windowLength_in);
+
+    if (signal_in[frame] >= localMaximum.maximum())
+      maxima_out.push_back(frame);
   }
 }
 
-void Rhythm::movingAverage(vector<float> signal_in, int windowLength_in,
-                           float threshold_in, vector<float>& average_out,
-                           vector<float>& difference_out) {
+void Rhythm::movingAverage(const float *signal_in, int length_in,
+                           int windowLength_in, float threshold_in,
+                           float *average_out, float *difference_out) {
+  int length = length_in;
   float avgWindowLength = (windowLength_in * 2) + 1;
-  for (unsigned frame = 0; frame < signal_in.size(); frame++) {
-    float result = 0;
-    for (int i = windowLength_in * -1; i < windowLength_in + 1; i++) {
-      if (frame + i >= 0 && frame + i < signal_in.size())
-        result += abs(signal_in.at(frame + i));
-    }
+
+  // start with the part of the window which is ahead of the first frame
+  double result = 0;
+  for (int i = 0; i < windowLength_in && i < length; i++)
+    result += abs(signal_in[i]);
+
+  for (int frame = 0; frame < length; frame++) {
+    // add the frame entering the window and drop the one leaving it
+    int entering = frame + windowLength_in;
+    if (entering < length)
+      result += abs(signal_in[entering]);
+    int leaving = frame - windowLength_in - 1;
+    if (leaving >= 0)
+      result -= abs(signal_in[leaving]);
 
     // calculate average and difference results
     float average = result / avgWindowLength + threshold_in;
-    float difference = signal_in.at(frame) - average;
+    float difference = signal_in[frame] - average;
     if (difference < 0)
       difference = 0;
 
-    average_out.push_back(average);
-    difference_out.push_back(difference);
+    average_out[frame] = average;
+    difference_out[frame] = difference;
   }
 }
 
-void Rhythm::normalise(vector<float> signal_in, vector<float>& normalised_out) {
+void Rhythm::normalise(const float *signal_in, int length_in,
+                       float *normalised_out) {
   // find mean
   float total = 0;
-  for (unsigned i = 0; i < signal_in.size(); i++)
-    total += signal_in.at(i);
-  float mean = total / signal_in.size();
+  for (int i = 0; i < length_in; i++)
+    total += signal_in[i];
+  float mean = total / length_in;
 
   // find std dev
   float std = 0;
-  for (unsigned i = 0; i < signal_in.size(); i++)
-    std += pow(signal_in.at(i) - mean, 2);
-  std = sqrt(std / signal_in.size());
+  for (int i = 0; i < length_in; i++)
+    std += pow(signal_in[i] - mean, 2);
+  std = sqrt(std / length_in);
 
   // normalise and rectify
-  for (unsigned i = 0; i < signal_in.size(); i++) {
-    normalised_out.push_back((signal_in.at(i) - mean) / std);
-    if (normalised_out.at(i) < 0)
-      normalised_out.at(i) = 0;
+  for (int i = 0; i < length_in; i++) {
+    normalised_out[i] = (signal_in[i] - mean) / std;
+    if (normalised_out[i] < 0)
+      normalised_out[i] = 0;
   }
 }
 
-void Rhythm::halfHannConvolve(vector<vector<float> >& envelope_out) {
-  for (unsigned frame = 0; frame < intensity.size(); frame++) {
-    vector<float> frameResult;
-    for (int subBand = 0; subBand < numBands; subBand++) {
-      float result = 0;
-      for (int shift = 0; shift < halfHannLength; shift++) {
-        if (frame + shift < intensity.size())
-          result += intensity.at(frame + shift).at(subBand)
-              * halfHannWindow[shift];
+/*!
+ * \brief Adds the sub-band intensities of a block to the end of intensity.
+ *
+ * Each sub-band is stored contiguously so that it can be convolved with unit
+ * stride. When the buffer is full, the capacity of every sub-band is doubled,
+ * in whole chunks of blocks.
+ */
+void Rhythm::appendIntensity(const vector<float>& bandTotal_in) {
+  if (intensityFrames == intensityCapacity) {
+    const int chunkFrames = 4096;
+    int newCapacity = intensityCapacity * 2;
+    if (newCapacity < chunkFrames)
+      newCapacity = chunkFrames;
+    newCapacity = (newCapacity + chunkFrames - 1) / chunkFrames * chunkFrames;
+
+    // move each sub-band to its new position
+    vector<float> grown(numBands * newCapacity);
+    for (int subBand = 0; subBand < numBands; subBand++)
+      std::copy(intensity.begin() + subBand * intensityCapacity,
+                intensity.begin() + subBand * intensityCapacity
+                    + intensityFrames,
+                grown.begin() + subBand * newCapacity);
+    intensity.swap(grown);
+    intensityCapacity = newCapacity;
+  }
+
+  for (int subBand = 0; subBand < numBands; subBand++)
+    intensity[subBand * intensityCapacity + intensityFrames] =
+        bandTotal_in[subBand];
+  intensityFrames++;
+}
+
+/*!
+ * \brief Sums the intensity of all sub-bands for each block.
+ *
+ * The result may be written over the first sub-band.
+ */
+void Rhythm::sumIntensity(float *total_out) {
+  std::copy(intensity.begin(), intensity.begin() + intensityFrames, total_out);
+  for (int subBand = 1; subBand < numBands; subBand++) {
+    const float *band = &intensity[subBand * intensityCapacity];
+    for (int frame = 0; frame < intensityFrames; frame++)
+      total_out[frame] += band[frame];
+  }
+}
+
+/*!
+ * \brief Returns the half-hanning envelope of a signal at a given frame,
+ * with the window cut short at the end of the signal.
+ */
+float Rhythm::envelopeAt(const float *total_in, int frames_in, int frame_in) {
+  float result = 0;
+  for (int shift = 0; shift < halfHannLength && frame_in + shift < frames_in;
+      shift++)
+    result += total_in[frame_in + shift] * halfHannWindow[shift];
+  return result;
+}
+
+/*!
+ * \brief Convolves the summed intensity with the half-hanning and canny
+ * windows to produce the onset curve.
+ *
+ * Frames far enough from the edges use the combined kernel in a single pass.
+ * Near the edges, where the windows are cut short, the envelope is found
+ * first and then convolved with the canny window.
+ */
+void Rhythm::onsetConvolve(const float *total_in, int frames_in,
+                           float *onset_out) {
+  int frames = frames_in;
+  std::fill(onset_out, onset_out + frames, 0.f);
+  if (frames == 0)
+    return;
+
+  const float *total = total_in;
+  float *onset = onset_out;
+  int taps = onsetKernel.size();
+
+  // frames whose kernel lies entirely within the signal
+  int begin = cannyLength;
+  int end = frames - (taps - cannyLength) + 1;
+  if (end < begin)
+    end = begin;
+
+  // accumulate one tap at a time across the interior frames
+  for (int tap = 0; tap < taps; tap++) {
+    const float *in = total + tap - cannyLength;
+    float coef = onsetKernel[tap];
+    int frame = begin;
+#if defined(RHYTHM_SSE)
+    __m128 k = _mm_set1_ps(coef);
+    for (; frame + 4 <= end; frame += 4) {
+      __m128 acc = _mm_loadu_ps(onset + frame);
+      acc = _mm_add_ps(acc, _mm_mul_ps(k, _mm_loadu_ps(in + frame)));
+      _mm_storeu_ps(onset + frame, acc);
+    }
+#endif
+    for (; frame < end; frame++)
+      onset[frame] += coef * in[frame];
+  }
+
+  // frames near the edges
+  for (int frame = 0; frame < frames; frame++) {
+    if (frame >= begin && frame < end)
+      continue;
+    float sum = 0;
+    for (int shift = cannyLength * -1; shift < cannyLength; shift++) {
+      if (frame + shift >= 0 && frame + shift < frames)
+        sum += envelopeAt(total, frames, frame + shift)
+            * cannyWindow[shift + cannyLength];
+    }
+    onset[frame] = sum;
+  }
+}
+
+/*!
+ * \brief Returns the number of frames in one beat at the given tempo.
+ */
+int Rhythm::delayInFrames(int bpm_in) const {
+  return (int) round(60.f / bpm_in * m_sampleRate / m_stepSize);
+}
+
+/*!
+ * \brief Returns the autocorrelation and local tempo of each tempogram window
+ * which has been completed.
+ */
+void Rhythm::pushTempogramFeatures(FeatureSet& output_out) {
+  vector<float>& autocor = windowAutocor;
+  int start, length;
+  while (tempogram.popWindow(autocor, start, length)) {
+    Vamp::RealTime timestamp = Vamp::RealTime::frame2RealTime(
+        (start + length / 2) * m_stepSize, m_sampleRate);
+
+    Feature f_tempogram;
+    f_tempogram.hasTimestamp = true;
+    f_tempogram.timestamp = timestamp;
+    f_tempogram.values = autocor;
+    output_out[10].push_back(f_tempogram);
+
+    // find tempo from the peaks of this window
+    vector<int>& autocorPeaks = windowPeaks;
+    vector<int>& autocorValleys = windowValleys;
+    autocorPeaks.clear();
+    autocorValleys.clear();
+    findCorrelationPeaks(autocor, 95, 3, firstShift, autocorPeaks,
+                         autocorValleys);
+    Feature f_localTempo;
+    f_localTempo.hasTimestamp = true;
+    f_localTempo.timestamp = timestamp;
+    f_localTempo.values.push_back(findTempo(autocorPeaks));
+    output_out[11].push_back(f_localTempo);
+  }
+}
+
+/*!
+ * \brief Returns the features which summarise the whole stream, from the
+ * onset count, the rhythm strength and the autocorrelation of the difference
+ * curve.
+ */
+void Rhythm::pushSummaryFeatures(int frames_in, int onsetCount_in,
+                                 float rhythmStrength_in,
+                                 const vector<float>& autocor_in,
+                                 const vector<int>& autocorPeaks_in,
+                                 const vector<int>& autocorValleys_in,
+                                 FeatureSet& output_out) {
+  // calculate average onset frequency
+  float averageOnsetFreq = (float) onsetCount_in
+      / (float) (frames_in * m_stepSize / m_sampleRate);
+  Feature f_avgOnsetFreq;
+  f_avgOnsetFreq.hasTimestamp = true;
+  f_avgOnsetFreq.timestamp = Vamp::RealTime::fromSeconds(0.0);
+  f_avgOnsetFreq.values.push_back(averageOnsetFreq);
+  output_out[4].push_back(f_avgOnsetFreq);
+
+  // push rhythm strength
+  Feature f_rhythmStrength;
+  f_rhythmStrength.hasTimestamp = true;
+  f_rhythmStrength.timestamp = Vamp::RealTime::fromSeconds(0.0);
+  f_rhythmStrength.values.push_back(rhythmStrength_in);
+  output_out[5].push_back(f_rhythmStrength);
+
+  // push autocorrelation
+  Feature f_autoCor;
+  f_autoCor.hasTimestamp = true;
+  for (int shift = firstShift; shift < lastShift; shift++) {
+    f_autoCor.timestamp = Vamp::RealTime::frame2RealTime(shift * m_stepSize,
+                                                         m_sampleRate);
+    f_autoCor.values.clear();
+    f_autoCor.values.push_back(autocor_in.at(shift - firstShift));
+    output_out[6].push_back(f_autoCor);
+  }
+
+  // find average corrolation peak
+  const float *autocor = autocor_in.empty() ? NULL : &autocor_in[0];
+  float meanCorrelationPeak = findMeanPeak(autocor, autocorPeaks_in,
+                                           firstShift);
+  Feature f_meanCorrelationPeak;
+  f_meanCorrelationPeak.hasTimestamp = true;
+  f_meanCorrelationPeak.timestamp = Vamp::RealTime::fromSeconds(0.0);
+  f_meanCorrelationPeak.values.push_back(meanCorrelationPeak);
+  output_out[7].push_back(f_meanCorrelationPeak);
+
+  // find peak/valley ratio
+  float meanCorrelationValley = findMeanPeak(autocor, autocorValleys_in,
+                                             firstShift) + 0.0001;
+  Feature f_peakValleyRatio;
+  f_peakValleyRatio.hasTimestamp = true;
+  f_peakValleyRatio.timestamp = Vamp::RealTime::fromSeconds(0.0);
+  f_peakValleyRatio.values.push_back(
+      meanCorrelationPeak / meanCorrelationValley);
+  output_out[8].push_back(f_peakValleyRatio);
+
+  // find tempo from peaks
+  float tempo = findTempo(autocorPeaks_in);
+  Feature f_tempo;
+  f_tempo.hasTimestamp = true;
+  f_tempo.timestamp = Vamp::RealTime::fromSeconds(0.0);
+  f_tempo.values.push_back(tempo);
+  output_out[9].push_back(f_tempo);
+}
+
+/*!
+ * \brief Finds the autocorrelation of a signal between firstShift and
+ * lastShift, and its peaks and valleys, from a decimated copy of the signal.
+ *
+ * The position and value of each peak and valley are refined by parabolic
+ * interpolation of the decimated autocorrelation, and the refined value
+ * replaces the linearly interpolated one at its delay.
+ */
+void Rhythm::decimatedAutocorrelation(const float *signal_in, int length_in,
+                                      vector<float>& autocor_out,
+                                      vector<int>& peaks_out,
+                                      vector<int>& valleys_out) {
+  int factor = decimation;
+  int length = length_in;
+  int decimatedLength = (length + factor - 1) / factor;
+
+  // low-pass filter with a windowed sinc, at the decimated positions only
+  int taps = factor * 4 + 1;
+  vector<float> filter(taps);
+  float filterTotal = 0;
+  for (int i = 0; i < taps; i++) {
+    float x = (float) (i - factor * 2) / factor;
+    float sinc = x == 0 ? 1.f : sin(M_PI * x) / (M_PI * x);
+    filter[i] = sinc * (0.5f - 0.5f * cos(2.f * M_PI * (i + 1) / (taps + 1)));
+    filterTotal += filter[i];
+  }
+  vector<float> decimated(decimatedLength, 0.f);
+  for (int m = 0; m < decimatedLength; m++) {
+    float result = 0;
+    for (int i = 0; i < taps; i++) {
+      int frame = m * factor + i - factor * 2;
+      if (frame >= 0 && frame < length)
+        result += signal_in[frame] * filter[i];
+    }
+    decimated[m] = result / filterTotal;
+  }
+
+  // autocorrelation of the decimated signal, covering the whole shift range
+  int startShift = firstShift / factor;
+  int endShift = (lastShift + factor - 1) / factor + 1;
+  vector<float> decimatedAutocor;
+  autocorrelation(&decimated[0], decimatedLength, startShift, endShift,
+                  decimatedAutocor);
+  int decimatedShifts = decimatedAutocor.size();
+  if (decimatedShifts == 0 || lastShift <= firstShift)
+    return;
+
+  // interpolate back to every shift
+  autocor_out.resize(std::max(lastShift - firstShift, 0));
+  for (int shift = firstShift; shift < lastShift; shift++) {
+    float pos = (float) shift / factor - startShift;
+    int below = std::min((int) pos, decimatedShifts - 1);
+    int above = std::min(below + 1, decimatedShifts - 1);
+    float fraction = pos - below;
+    autocor_out[shift - firstShift] = decimatedAutocor[below] * (1 - fraction)
+        + decimatedAutocor[above] * fraction;
+  }
+
+  // find peaks in the decimated autocorrelation
+  int windowLength = std::max((3 + factor - 1) / factor, 1);
+  vector<int> decimatedPeaks;
+  vector<int> decimatedValleys;
+  findCorrelationPeaks(decimatedAutocor, 95, windowLength, startShift,
+                       decimatedPeaks, decimatedValleys);
+
+  // refine each peak and valley by fitting a parabola through its
+  // neighbours, so that the signal is not passed over again
+  for (int pass = 0; pass < 2; pass++) {
+    bool peaks = pass == 0;
+    const vector<int>& found = peaks ? decimatedPeaks : decimatedValleys;
+    vector<int>& refined = peaks ? peaks_out : valleys_out;
+    for (unsigned i = 0; i < found.size(); i++) {
+      int pos = found[i] - startShift;
+      float offset = 0;
+      float value = decimatedAutocor[pos];
+      if (pos > 0 && pos < decimatedShifts - 1) {
+        float a = decimatedAutocor[pos - 1];
+        float b = decimatedAutocor[pos];
+        float c = decimatedAutocor[pos + 1];
+        float curvature = a - 2 * b + c;
+        if (curvature != 0)
+          offset = 0.5f * (a - c) / curvature;
+        offset = std::max(-0.5f, std::min(0.5f, offset));
+        value = b - 0.25f * (a - c) * offset;
       }
-      frameResult.push_back(result);
+
+      // use the value at the top of the parabola for the nearest delay,
+      // which the filter can push below zero although the difference
+      // signal, and so its autocorrelation, never is
+      value = std::max(value, 0.f);
+      int shift = (int) round((found[i] + offset) * factor);
+      shift = std::max(firstShift, std::min(shift, lastShift - 1));
+      autocor_out[shift - firstShift] = value;
+      refined.push_back(shift);
     }
-    envelope_out.push_back(frameResult);
   }
 }
 
-void Rhythm::cannyConvolve(vector<vector<float> > envelope_in,
-                           vector<float>& onset_out) {
-  for (unsigned frame = 0; frame < envelope_in.size(); frame++) {
-    // reset feature details
-    float sum = 0;
+/*!
+ * \brief Runs each stage of the streaming pipeline for as many blocks as it
+ * has enough history for, returning the features which become known.
+ *
+ * Each stage waits until the later blocks it depends on have been through
+ * the stage before it. The stages take turns to advance by one block, so
+ * none of them gets further ahead of the next than its history allows. At
+ * the end of the stream (finished_in), the last blocks of each stage are
+ * processed with their windows cut short, as in getRemainingFeatures().
+ */
+void Rhythm::advanceStream(bool finished_in, FeatureSet& output_out) {
+  bool progressed = true;
+  while (progressed) {
+    progressed = false;
+
+    // envelope of the summed intensity, which looks ahead by the
+    // half-hanning window
+    if (envelopeFrames < streamFrames
+        && (finished_in || envelopeFrames + halfHannLength <= streamFrames)) {
+      int frame = envelopeFrames;
+      float result = 0;
+      for (int shift = 0;
+          shift < halfHannLength && frame + shift < streamFrames; shift++)
+        result += totalHistory[(frame + shift) % halfHannLength]
+            * halfHannWindow[shift];
+      envelopeHistory[frame % envelopeHistory.size()] = result;
+      envelopeFrames++;
+      progressed = true;
+    }
 
-    // for each sub-band
-    for (int subBand = 0; subBand < numBands; subBand++) {
-      // convolve the canny window with the envelope of that sub-band
+    // onset curve, which looks back and ahead by the canny window
+    bool envelopeDone = finished_in && envelopeFrames == streamFrames;
+    if (onsetFrames < envelopeFrames
+        && (envelopeDone || onsetFrames + cannyLength <= envelopeFrames)) {
+      int frame = onsetFrames;
+      float sum = 0;
       for (int shift = cannyLength * -1; shift < cannyLength; shift++) {
-        if (frame + shift >= 0 && frame + shift < envelope_in.size())
-          sum += envelope_in.at(frame + shift).at(subBand)
+        if (frame + shift >= 0 && frame + shift < envelopeFrames)
+          sum += envelopeHistory[(frame + shift) % envelopeHistory.size()]
               * cannyWindow[shift + cannyLength];
       }
+      onsetFrames++;
+      pushStreamOnset(frame, sum, output_out);
+      progressed = true;
     }
 
-    // save result
-    onset_out.push_back(sum);
+    // moving average and difference, which look back and ahead by the
+    // average window
+    bool onsetDone = envelopeDone && onsetFrames == streamFrames;
+    if (averageFrames < onsetFrames
+        && (onsetDone || averageFrames + average_window < onsetFrames)) {
+      int frame = averageFrames;
+      int historySize = normHistory.size();
+
+      // add the frames entering the window and drop the one leaving it
+      for (; averageEntered <= frame + average_window
+          && averageEntered < onsetFrames; averageEntered++)
+        averageTotal += abs(normHistory[averageEntered % historySize]);
+      int leaving = frame - average_window - 1;
+      if (leaving >= 0)
+        averageTotal -= abs(normHistory[leaving % historySize]);
+
+      float average = averageTotal / (float) (average_window * 2 + 1)
+          + threshold;
+      float difference = normHistory[frame % historySize] - average;
+      if (difference < 0)
+        difference = 0;
+      averageFrames++;
+      pushStreamDifference(frame, average, difference, output_out);
+      progressed = true;
+    }
+
+    // onsets, which look back and ahead by the peak window
+    bool averageDone = onsetDone && averageFrames == streamFrames;
+    if (peakFrames < averageFrames
+        && (averageDone || peakFrames + peak_window < averageFrames)) {
+      int frame = peakFrames;
+      int historySize = diffHistory.size();
+
+      // slide the maximum of the peak window on by one frame
+      for (; peakEntered <= frame + peak_window
+          && peakEntered < averageFrames; peakEntered++)
+        peakMaximum.push(peakEntered,
+                         diffHistory[peakEntered % historySize]);
+      peakMaximum.dropBefore(frame - peak_window);
+
+      float value = diffHistory[frame % historySize];
+      bool isPeak = value > 0 && value >= peakMaximum.maximum();
+
+      if (isPeak) {
+        Feature f_peak;
+        f_peak.hasTimestamp = true;
+        f_peak.timestamp = Vamp::RealTime::frame2RealTime(frame * m_stepSize,
+                                                          m_sampleRate);
+        output_out[3].push_back(f_peak);
+        streamOnsets++;
+        streamOnsetTotal += onsetHistory[frame % onsetHistory.size()];
+      }
+      peakFrames++;
+      progressed = true;
+    }
   }
 }
+
+/*!
+ * \brief Normalises a new value of the onset curve against the values before
+ * it, and returns it.
+ *
+ * The mean and variance are updated with Welford's method, so they stay
+ * accurate over long streams.
+ */
+void Rhythm::pushStreamOnset(int frame_in, float onset_in,
+                             FeatureSet& output_out) {
+  double delta = onset_in - onsetMean;
+  onsetMean += delta / (frame_in + 1);
+  onsetVariance += delta * (onset_in - onsetMean);
+  double std = sqrt(onsetVariance / (frame_in + 1));
+
+  float normalised = 0;
+  if (std > 0)
+    normalised = (onset_in - onsetMean) / std;
+  if (normalised < 0)
+    normalised = 0;
+
+  onsetHistory[frame_in % onsetHistory.size()] = onset_in;
+  normHistory[frame_in % normHistory.size()] = normalised;
+
+  Feature f_onset;
+  f_onset.hasTimestamp = true;
+  f_onset.timestamp = Vamp::RealTime::frame2RealTime(frame_in * m_stepSize,
+                                                     m_sampleRate);
+  f_onset.values.push_back(normalised);
+  output_out[0].push_back(f_onset);
+}
+
+/*!
+ * \brief Returns the moving average and difference of a block, and adds the
+ * difference to the running autocorrelation.
+ */
+void Rhythm::pushStreamDifference(int frame_in, float average_in,
+                                  float difference_in, FeatureSet& output_out) {
+  int historySize = diffHistory.size();
+  diffHistory[frame_in % historySize] = difference_in;
+  if (tempogram_hop > 0)
+    tempogram.push(difference_in);
+
+  // correlate with each of the earlier blocks within the shift range
+  for (int shift = firstShift; shift < lastShift && shift <= frame_in;
+      shift++)
+    autocorTotal[shift - firstShift] += (double) difference_in
+        * diffHistory[(frame_in - shift) % historySize];
+
+  Vamp::RealTime timestamp = Vamp::RealTime::frame2RealTime(
+      frame_in * m_stepSize, m_sampleRate);
+
+  Feature f_avg;
+  f_avg.hasTimestamp = true;
+  f_avg.timestamp = timestamp;
+  f_avg.values.push_back(average_in);
+  output_out[1].push_back(f_avg);
+
+  Feature f_diff;
+  f_diff.hasTimestamp = true;
+  f_diff.timestamp = timestamp;
+  f_diff.values.push_back(difference_in);
+  output_out[2].push_back(f_diff);
+
+  if (tempogram_hop > 0)
+    pushTempogramFeatures(output_out);
+}
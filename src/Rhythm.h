@@ -25,6 +25,11 @@
 #include <vector>
 #include <algorithm>
 #include <vamp-sdk/Plugin.h>
+#include "BandMap.h"
+#include "Magnitudes.h"
+#include "FourierTransform.h"
+#include "Tempogram.h"
+#include "SlidingMaximum.h"
 
 using std::string;
 using std::vector;
@@ -59,6 +64,10 @@ using std::cos;
  * The mean peak-valley ratio of the autocorrelation.
  * \par Tempo
  * The estimated tempo in beats per minute.
+ * \par Tempogram
+ * The autocorrelation of the difference curve over a sliding window.
+ * \par Local tempo
+ * The estimated tempo of each tempogram window in beats per minute.
  *
  * \section Parameters
  * \par Sub-bands
@@ -77,6 +86,19 @@ using std::cos;
  * Minimum tempo calculated using the autocorrelation. (default = 12)
  * \par Maximum BPM
  * Maximum tempo calculated using the autocorrelation. (default = 300)
+ * \par Decimation
+ * Factor by which the difference curve is decimated before finding the
+ * autocorrelation and its peaks, where 1 leaves it at full resolution.
+ * (default = 1)
+ * \par Tempogram window length
+ * Length of the window used for the tempogram, which is rounded up to a
+ * whole number of hops. (default = 2048)
+ * \par Tempogram hop
+ * Number of frames between the start of each tempogram window, or 0 to leave
+ * out the tempogram and local tempo. (default = 128)
+ * \par Streaming mode
+ * Whether to return the onset curve, average, difference and onsets during
+ * processing rather than at the end of the stream. (default = 0)
  *
  * \section Description
  *
@@ -102,20 +124,26 @@ using std::cos;
  * w\in[-L,L] \f]
  *
  * The \f$n\f$ signals are summed and half-wave rectified to produce the
- * <b>onset curve</b>.
+ * <b>onset curve</b>. As both convolutions are linear, the sub-bands are
+ * summed first and then convolved once with the combination of the two
+ * windows, with the edges of the signal handled as if the windows had been
+ * applied one after the other.
  *
  * The <b>moving average</b> \f$A\f$ of the onset curve \f$O\f$ is produced from
  * the mean value of a rectangular window of length \f$(2L+1)\f$, plus a
  * threshold \f$t\f$. The <i>threshold</i> and <i>moving average window
  * length</i> parameters control \f$t\f$ and \f$L\f$ respectively.
  * \f[ A(x) = \displaystyle\sum\limits_{y=-L}^{L} \frac{O(x+y)}{2L+1} + t \f]
+ * The sum is kept as a running total, so the cost does not depend on \f$L\f$.
  *
  * The <b>difference</b> signal is created by subtracting the moving average
  * from the onset curve and applying half-wave rectification.
  *
  * An <b>onset</b> is detected when a sample is the maximum within a given
  * window of length \f$(2L+1)\f$, where \f$L\f$ is set by the parameter <i>onset
- * peak window length</i>.
+ * peak window length</i>. The maximum of each window is tracked with a
+ * monotonic deque as the window slides, in streaming mode as well, so peak
+ * picking takes linear time.
  *
  * The <b>average onset frequency</b> is the total number of onsets divided by
  * the length of the track in minutes.
@@ -127,7 +155,9 @@ using std::cos;
  * between delays of \f$\frac{60}{T_{max}}\cdot\frac{F_s}{s}\f$ frames and
  * \f$\frac{60}{T_{min}}\cdot\frac{F_s}{s}\f$ frames, where \f$T_{min}\f$ and
  * \f$T_{max}\f$ are the min/max tempo in BPM and \f$s\f$ is the step size in
- * number of frames.
+ * number of frames. For long signals it is found from the inverse FFT of the
+ * power spectrum of the zero-padded difference signal, which gives the same
+ * result in \f$O(N \log N)\f$ time.
  *
  * The peaks of the autocorrelation - \f$P_i\f$ - are defined as those which are
  * above a certain threshold, defined as the 95% confidence interval, and whose
@@ -141,6 +171,44 @@ using std::cos;
  * \f[ T = \underset{P_k}{argmin} \displaystyle\sum\limits_{i=1}^{N}
  * \left|\frac{P_i}{P_k}-\text{round}\left(\frac{P_i}{P_k}\right)\right|\f]
  *
+ * If the <i>decimation</i> factor \f$D\f$ is more than 1, the difference
+ * signal is low-pass filtered with a Hann-windowed sinc of \f$4D+1\f$ taps,
+ * and every \f$D\f$th sample is kept. Filtering costs about four
+ * multiply-adds per block whatever the factor, and the autocorrelation of the
+ * decimated signal takes between \f$D\f$ times less work when it is found
+ * with an FFT and \f$D^2\f$ times less when it is found directly. The
+ * autocorrelation is linearly interpolated back to every delay, and the
+ * position and value of each peak and valley are refined by fitting a
+ * parabola through it and its neighbours, so the signal is not read again.
+ * As the filter smooths narrow peaks, the mean correlation peak and
+ * peak-valley ratio are lowered as the factor grows, by around a tenth for a
+ * factor of 4. The tempo is normally unchanged for factors up to 4, but
+ * peaks closer together than \f$D\f$ delays may be merged. This option does
+ * not apply in streaming mode, where the autocorrelation is accumulated at
+ * full resolution as each block arrives.
+ *
+ * The <b>tempogram</b> is the autocorrelation of the difference signal over
+ * each window, between the same delays as above, divided by the window
+ * length. Each window is correlated with the difference signal up to the
+ * longest delay after it. The signal is split into blocks of one hop, and
+ * the correlation of each block is found once with an FFT and then added to
+ * and later removed from a running total as the window slides, so the cost
+ * grows linearly with the length of the track. The <b>local tempo</b> is
+ * found from the peaks of each window's autocorrelation in the same way as the
+ * tempo, and both are timestamped at the centre of the window.
+ *
+ * In <b>streaming mode</b>, each stage runs inside process() on a short
+ * history of blocks, and its results are returned as soon as the blocks it
+ * depends on have arrived. The onset curve is returned 22 blocks after the
+ * audio, and the average, difference and onsets after a further moving
+ * average window length and onset peak window length respectively. As the
+ * statistics of the whole onset curve are not known until the end, each
+ * block is normalised against the mean and standard deviation of the blocks
+ * before it. The autocorrelation is accumulated as each difference value
+ * arrives, so only as many blocks as the longest delay (set by the minimum
+ * BPM) are kept, and the summary features are returned at the end of the
+ * stream.
+ *
  * \section References
  *
  * [1] <i>Lu, L., Liu, D., & Zhang, H.-J. (2006). Automatic Mood Detection and
@@ -179,28 +247,60 @@ class Rhythm : public Vamp::Plugin {
                      Vamp::RealTime timestamp);
   FeatureSet getRemainingFeatures();
   /// @endcond
+  FeatureSet processMagnitudes(const float *magnitudes_in,
+                               Vamp::RealTime timestamp);
+  void processMagnitudes(const float *magnitudes_in, Vamp::RealTime timestamp,
+                         FeatureSet& output_out);
 
  protected:
   void calculateBandFreqs();
   float halfHanning(float n);
   float canny(float n);
-  float findRemainder(vector<int> peaks, int thisPeak);
-  float findTempo(vector<int> peaks);
-  float findMeanPeak(vector<float> signal, vector<int> peaks, int shift);
-  void findCorrelationPeaks(vector<float> autocor_in, float percentile_in,
-                            int windowLength_in, int shift_in,
-                            vector<int>& peaks_out, vector<int>& valleys_out);
-  void autocorrelation(vector<float> signal_in, int startShift_in,
-                       int endShift_in, vector<float>& autocor_out);
-  void findOnsetPeaks(vector<float> onset_in, int windowLength_in,
-                      vector<int>& peaks_out);
-  void movingAverage(vector<float> signal_in, int windowLength_in,
-                     float threshold_in, vector<float>& average_out,
-                     vector<float>& difference_out);
-  void normalise(vector<float> signal_in, vector<float>& normalised_out);
-  void halfHannConvolve(vector<vector<float> >& envelope_out);
-  void cannyConvolve(vector<vector<float> > envelope_in,
-                     vector<float>& onset_out);
+  float findRemainder(const vector<int>& peaks, int thisPeak);
+  float findTempo(const vector<int>& peaks);
+  float findMeanPeak(const float *signal, const vector<int>& peaks, int shift);
+  void findCorrelationPeaks(const vector<float>& autocor_in,
+                            float percentile_in, int windowLength_in,
+                            int shift_in, vector<int>& peaks_out,
+                            vector<int>& valleys_out);
+  void autocorrelation(const float *signal_in, int length_in,
+                       int startShift_in, int endShift_in,
+                       vector<float>& autocor_out);
+  void directAutocorrelation(const float *signal_in, int length_in,
+                             int startShift_in, int endShift_in,
+                             vector<float>& autocor_out);
+  void fftAutocorrelation(const float *signal_in, int length_in,
+                          int startShift_in, int endShift_in,
+                          vector<float>& autocor_out);
+  void findOnsetPeaks(const float *onset_in, int length_in,
+                      int windowLength_in, vector<int>& peaks_out);
+  void findLocalMaxima(const float *signal_in, int length_in,
+                       int windowLength_in, vector<int>& maxima_out);
+  void movingAverage(const float *signal_in, int length_in,
+                     int windowLength_in, float threshold_in,
+                     float *average_out, float *difference_out);
+  void normalise(const float *signal_in, int length_in,
+                 float *normalised_out);
+  int delayInFrames(int bpm_in) const;
+  void pushTempogramFeatures(FeatureSet& output_out);
+  void pushSummaryFeatures(int frames_in, int onsetCount_in,
+                           float rhythmStrength_in,
+                           const vector<float>& autocor_in,
+                           const vector<int>& autocorPeaks_in,
+                           const vector<int>& autocorValleys_in,
+                           FeatureSet& output_out);
+  void decimatedAutocorrelation(const float *signal_in, int length_in,
+                                vector<float>& autocor_out,
+                                vector<int>& peaks_out,
+                                vector<int>& valleys_out);
+  void advanceStream(bool finished_in, FeatureSet& output_out);
+  void pushStreamOnset(int frame_in, float onset_in, FeatureSet& output_out);
+  void pushStreamDifference(int frame_in, float average_in, float difference_in,
+                            FeatureSet& output_out);
+  void appendIntensity(const vector<float>& bandTotal_in);
+  void sumIntensity(float *total_out);
+  float envelopeAt(const float *total_in, int frames_in, int frame_in);
+  void onsetConvolve(const float *total_in, int frames_in, float *onset_out);
 
   /// @cond
   int m_blockSize, m_stepSize;
@@ -209,17 +309,65 @@ class Rhythm : public Vamp::Plugin {
 
   int numBands;         /*!< Number of sub-bands */
   float *bandHighFreq;  /*!< Upper frequency of each sub-band */
+  BandMap bandMap;      /*!< Range of FFT bins in each sub-band */
+  vector<float> magnitudes; /*!< Magnitude of each FFT bin in the current block */
+  vector<float> bandTotal;  /*!< Sum of the magnitudes in each sub-band in the current block */
   int halfHannLength;   /*!< Length of half-hanning window */
   float *halfHannWindow;/*!< Co-efficients of half-hanning window */
   int cannyLength;      /*!< Length of canny window */
   float cannyShape;     /*!< Shape of canny window */
   float *cannyWindow;   /*!< Co-efficients of canny window */
-  vector<vector<float> > intensity; /*!< Intensity value for each block */
+  vector<float> onsetKernel; /*!< Half-hanning window convolved with the
+                                  canny window */
+  vector<float> intensity; /*!< Intensity of each sub-band for each block,
+                                stored one sub-band after another */
+  int intensityFrames;   /*!< Number of blocks stored in intensity */
+  int intensityCapacity; /*!< Number of blocks each sub-band has room for */
   float threshold;      /*!< Theshold value added to moving average */
   int average_window;   /*!< Length of moving average window */
   int peak_window;      /*!< Length of peak-picking window */
   int max_bpm;          /*!< Maximum BPM detected in autocorrelation */
   int min_bpm;          /*!< Minimum BPM detected in autocorrelation */
+  int firstShift;       /*!< Shortest delay of the autocorrelation in blocks */
+  int lastShift;        /*!< Longest delay of the autocorrelation in blocks */
+  int decimation;       /*!< Factor to decimate the difference curve by for
+                             the autocorrelation */
+  int tempogram_window; /*!< Length of tempogram window */
+  int tempogram_hop;    /*!< Number of frames between tempogram windows, or
+                             0 for no tempogram */
+  Tempogram tempogram;  /*!< Sliding autocorrelation of the difference */
+  vector<float> windowAutocor; /*!< Autocorrelation of the current tempogram
+                                    window */
+  vector<int> windowPeaks;     /*!< Peaks of the current tempogram window */
+  vector<int> windowValleys;   /*!< Valleys of the current tempogram window */
+  vector<float> selectScratch; /*!< Scratch space for the peak threshold */
+  vector<int> maximaScratch;   /*!< Scratch space for the local maxima */
+  SlidingMaximum localMaximum; /*!< Sliding maximum used to find local maxima */
+  bool streaming;       /*!< Flag to indicate whether to return features
+                             during processing */
+
+  // state of each stage when streaming, where each history is a circular
+  // buffer indexed by block number
+  int streamFrames;     /*!< Number of blocks processed */
+  int envelopeFrames;   /*!< Number of blocks with a known envelope */
+  int onsetFrames;      /*!< Number of blocks with a known onset value */
+  int averageFrames;    /*!< Number of blocks with a known moving average */
+  int averageEntered;   /*!< Number of blocks added to averageTotal */
+  int peakFrames;       /*!< Number of blocks checked for onsets */
+  int peakEntered;      /*!< Number of blocks added to peakMaximum */
+  int streamOnsets;     /*!< Number of onsets found */
+  float streamOnsetTotal; /*!< Total of the onset curve at each onset */
+  double onsetMean;     /*!< Mean of the onset values so far */
+  double onsetVariance; /*!< Sum of squared deviations of the onset values */
+  double averageTotal;  /*!< Total of the moving average window */
+  vector<float> totalHistory;    /*!< Summed intensity of recent blocks */
+  vector<float> envelopeHistory; /*!< Envelope of recent blocks */
+  vector<float> onsetHistory;    /*!< Onset values of recent blocks */
+  vector<float> normHistory;     /*!< Normalised onset values of recent blocks */
+  vector<float> diffHistory;     /*!< Difference values of recent blocks */
+  vector<double> autocorTotal;   /*!< Running autocorrelation of the difference */
+  SlidingMaximum peakMaximum;    /*!< Largest difference value within the peak
+                                      window */
 };
 
 #endif
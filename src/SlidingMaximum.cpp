@@ -0,0 +1,89 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <cassert>
+#include "SlidingMaximum.h"
+
+SlidingMaximum::SlidingMaximum() {
+  capacity = 1;
+  front = 0;
+  count = 0;
+}
+
+/*!
+ * \brief Makes room for the given number of values, and empties the window.
+ *
+ * Memory is only allocated if the capacity is larger than before, so the
+ * window can be re-initialised for each search without allocating.
+ */
+void SlidingMaximum::initialise(int capacity) {
+  this->capacity = capacity < 1 ? 1 : capacity;
+  if ((int) positions.size() < this->capacity) {
+    positions.resize(this->capacity);
+    values.resize(this->capacity);
+  }
+  clear();
+}
+
+/*!
+ * \brief Removes all values, without releasing memory.
+ */
+void SlidingMaximum::clear() {
+  front = 0;
+  count = 0;
+}
+
+/*!
+ * \brief Adds a value at the given position, which must be after the
+ * positions of the values already added, dropping the values which can no
+ * longer be the maximum.
+ */
+void SlidingMaximum::push(int position, float value) {
+  while (count > 0 && values[(front + count - 1) % capacity] <= value)
+    count--;
+
+  assert(count < capacity);
+  int back = (front + count) % capacity;
+  positions[back] = position;
+  values[back] = value;
+  count++;
+}
+
+/*!
+ * \brief Removes the values added at positions before the given one.
+ */
+void SlidingMaximum::dropBefore(int position) {
+  while (count > 0 && positions[front] < position) {
+    front = (front + 1) % capacity;
+    count--;
+  }
+}
+
+/*!
+ * \brief Returns the largest value in the window, which must not be empty.
+ */
+float SlidingMaximum::maximum() const {
+  assert(count > 0);
+  return values[front];
+}
+
+/*!
+ * \brief Returns whether the window holds no values.
+ */
+bool SlidingMaximum::empty() const {
+  return count == 0;
+}
@@ -0,0 +1,55 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _SLIDING_MAXIMUM_H_
+#define _SLIDING_MAXIMUM_H_
+
+#include <vector>
+
+using std::vector;
+
+/*!
+ * \brief Maximum of the values inside a sliding window
+ *
+ * The values which could still become the maximum are kept in a monotonic
+ * deque, in descending order, with the position each was added at. Each
+ * value enters and leaves the deque once, so sliding the window over n values
+ * takes O(n) time regardless of its length.
+ *
+ * The deque is a circular buffer sized by initialise(), so no memory is
+ * allocated while the window slides. The caller is responsible for never
+ * holding more values than the capacity given to initialise().
+ */
+class SlidingMaximum {
+ public:
+  SlidingMaximum();
+  void initialise(int capacity);
+  void clear();
+  void push(int position, float value);
+  void dropBefore(int position);
+  float maximum() const;
+  bool empty() const;
+
+ protected:
+  int capacity;            /*!< Number of values the deque can hold */
+  int front;               /*!< Index of the largest value */
+  int count;               /*!< Number of values in the deque */
+  vector<int> positions;   /*!< Position of each value in the deque */
+  vector<float> values;    /*!< Values in the deque, in descending order */
+};
+
+#endif
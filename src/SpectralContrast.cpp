@@ -224,6 +224,10 @@ SpectralContrast::initialise(size_t channels, size_t stepSize, size_t blockSize)
 
     m_blockSize = blockSize;
     m_stepSize = stepSize;
+    bandMap.initialise(bandHighFreq, numBands, m_sampleRate, m_blockSize);
+
+    // the sub-bands cover every bin in order, so each is a slice of one buffer
+    magnitudes.assign(m_blockSize/2, 0.f);
     reset();
 
     return true;
@@ -237,108 +241,136 @@ SpectralContrast::reset()
 SpectralContrast::FeatureSet
 SpectralContrast::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
 {
-	FeatureSet output;
-  Feature valleysOut;
-  Feature peaksOut;
-  Feature meanOut;
-  int currentBand = 0;
+  // get absolute value of each frequency bin
+  calculateMagnitudes(inputBuffers[0], m_blockSize/2, &magnitudes[0]);
 
-  // create vector of vectors
-  vector<float> empty;
-	vector< vector<float> > bins;
-	bins.push_back(empty);
+  return processMagnitudes(&magnitudes[0], timestamp);
+}
 
-  // for each frequency bin
-  for (int i=0; i<m_blockSize/2; i++)
-  {
-    // get absolute value
-    float binVal = abs(complex<float>(inputBuffers[0][i*2], inputBuffers[0][i*2+1]));
+SpectralContrast::FeatureSet
+SpectralContrast::getRemainingFeatures()
+{
+    return FeatureSet();
+}
 
-    // find centre frequency of this bin
-    float freq = (i+1)*m_sampleRate / (float)m_blockSize;
+/// @endcond
 
-    // locate which band this bin belongs in
-    while (freq > bandHighFreq[currentBand]) {
-      currentBand++;
-      if (currentBand >= numBands) break;
-      bins.push_back(empty);
-    }
+/*!
+ * \brief Calculates the upper frequency for each of a given
+ * number of sub-bands.
+ */
+void
+SpectralContrast::calculateBandFreqs()
+{
+  delete [] bandHighFreq;
+  bandHighFreq = new float[numBands];
 
-    // add the bin to the relevent band vector
-    bins.at(currentBand).push_back(binVal);
+  for (int k=0; k<numBands; k++)
+  {
+    bandHighFreq[k] = m_sampleRate / pow(2.f,numBands-k);
   }
+}
+
+/*!
+ * \brief Calculates the spectral contrast features of a block from the
+ * magnitude of each FFT bin, which may be shared with other plugins.
+ *
+ * \param binMagnitudes Magnitude of each of the blockSize/2 FFT bins
+ * \param timestamp Time of the block
+ */
+SpectralContrast::FeatureSet
+SpectralContrast::processMagnitudes(const float *binMagnitudes, Vamp::RealTime timestamp)
+{
+  FeatureSet output;
+  processMagnitudes(binMagnitudes, timestamp, output);
+  return output;
+}
+
+/*!
+ * \brief Calculates the spectral contrast features of a block from the
+ * magnitude of each FFT bin, and adds them to the lists in output, which may
+ * be reused from block to block.
+ */
+void
+SpectralContrast::processMagnitudes(const float *binMagnitudes, Vamp::RealTime timestamp,
+                                    FeatureSet &output)
+{
+  Feature valleysOut;
+  Feature peaksOut;
+  Feature meanOut;
+  valleysOut.values.reserve(numBands);
+  peaksOut.values.reserve(numBands);
+  meanOut.values.reserve(numBands);
+
+  // the bins are reordered in place, so work on a copy of shared magnitudes
+  if (binMagnitudes != &magnitudes[0])
+    std::copy(binMagnitudes, binMagnitudes + m_blockSize/2, magnitudes.begin());
 
   // for each band
   for (int band=0; band<numBands; band++)
   {
-    // sort the bins by magnitude
-    std::sort(bins.at(band).begin(), bins.at(band).end());
+    float *first = &magnitudes[0] + bandMap.getFirstBin(band);
+    int count = bandMap.getLastBin(band) - bandMap.getFirstBin(band);
+    if (count == 0)
+    {
+      valleysOut.values.push_back(0.f);
+      peaksOut.values.push_back(0.f);
+      meanOut.values.push_back(0.f);
+      continue;
+    }
 
-    // find the start and end of valley bins
-    int start = 0;
-    int end = 1;
-    if (bins.at(band).size() >= (1/alpha)) end = round(bins.at(band).size()*alpha);
-    float valleySum = 0;
+    // find the end of the valley bins and the start of the peak bins
+    int valleyEnd = 1;
+    int peakStart = count-1;
+    if (count >= (1/alpha))
+    {
+      valleyEnd = round(count*alpha);
+      peakStart = count - round(count*alpha);
+    }
 
-    // find average of those bins
-    for (int i=start; i<end; i++)
+    // only the valley and peak bins need to be in order, so select the
+    // lowest and highest bins at either end and sort just those, in place
+    float *last = first + count;
+    if (peakStart < valleyEnd)
     {
-      valleySum += bins.at(band).at(i);
+      std::sort(first, last);
+    }
+    else
+    {
+      std::nth_element(first, first + valleyEnd, last);
+      std::nth_element(first + valleyEnd, first + peakStart, last);
+      std::sort(first, first + valleyEnd);
+      std::sort(first + peakStart, last);
     }
-    valleysOut.values.push_back(valleySum / (float)(end - start));
 
-    // find the start and end of peak bins
-    start = bins.at(band).size()-1;
-    if (bins.at(band).size() >= (1/alpha)) start = bins.at(band).size() - round(bins.at(band).size()*alpha);
-    end = bins.at(band).size();
-    float peakSum = 0;
+    // find average of the valley bins
+    float valleySum = 0;
+    for (int i=0; i<valleyEnd; i++)
+    {
+      valleySum += first[i];
+    }
+    valleysOut.values.push_back(valleySum / (float)valleyEnd);
 
-    // find average of those bins
-    for (int i=start; i<end; i++)
+    // find average of the peak bins
+    float peakSum = 0;
+    for (int i=peakStart; i<count; i++)
     {
-      peakSum += bins.at(band).at(i);
+      peakSum += first[i];
     }
-    peaksOut.values.push_back(peakSum / (float)(end - start));
+    peaksOut.values.push_back(peakSum / (float)(count - peakStart));
 
-    // find average of all bins in band
-    start = 0;
-    end = bins.at(band).size();
-    float meanSum = 0;
-    for (int i=start; i<end; i++)
+    // find average of all bins in band, which are no longer in order, so
+    // sum them in double precision
+    double meanSum = 0;
+    for (int i=0; i<count; i++)
     {
-      meanSum += bins.at(band).at(i);
+      meanSum += first[i];
     }
-    meanOut.values.push_back(meanSum / (float)end);
+    meanOut.values.push_back(meanSum / (double)count);
   }
 
   // save outputs
   output[0].push_back(valleysOut);
   output[1].push_back(peaksOut);
   output[2].push_back(meanOut);
-
-  return output;
-}
-
-SpectralContrast::FeatureSet
-SpectralContrast::getRemainingFeatures()
-{
-    return FeatureSet();
-}
-
-/// @endcond
-
-/*!
- * \brief Calculates the upper frequency for each of a given
- * number of sub-bands.
- */
-void
-SpectralContrast::calculateBandFreqs()
-{
-  delete [] bandHighFreq;
-  bandHighFreq = new float[numBands];
-
-  for (int k=0; k<numBands; k++)
-  {
-    bandHighFreq[k] = m_sampleRate / pow(2.f,numBands-k);
-  }
 }
@@ -23,6 +23,8 @@
 #include <algorithm>
 #include <vector>
 #include <vamp-sdk/Plugin.h>
+#include "BandMap.h"
+#include "Magnitudes.h"
 
 using std::string;
 using std::vector;
@@ -56,6 +58,10 @@ using std::abs;
  * can be found by subtracting the valley from the peak in each sub-band,
  * although this isn't calculated in the plugin.
  *
+ * Only the peak and valley bins need to be in order, so rather than sorting
+ * each sub-band, they are selected in linear time with std::nth_element and
+ * only those few are sorted before being averaged.
+ *
  * [1] Jiang, D.-N., Lu, L., & Zhang, H.-J. (2002). Music type classification
  * by spectral contrast feature. IEEE International Conference on Multimedia
  * and Expo (pp. 113–116).
@@ -96,6 +102,10 @@ public:
     FeatureSet getRemainingFeatures();
     void calculateBandFreqs();
     /// @endcond
+    FeatureSet processMagnitudes(const float *binMagnitudes,
+                                 Vamp::RealTime timestamp);
+    void processMagnitudes(const float *binMagnitudes,
+                           Vamp::RealTime timestamp, FeatureSet &output);
 
 protected:
     /// @cond
@@ -106,6 +116,8 @@ protected:
     float alpha;          /*!< Alpha parameter of spectral contrast algorithm*/
     int numBands;         /*!< Number of sub-bands to use */
     float *bandHighFreq;  /*!< Upper frequency range of each sub-band */
+    BandMap bandMap;      /*!< Range of FFT bins in each sub-band */
+    vector<float> magnitudes; /*!< Magnitudes of the FFT bins, which each sub-band selects from in place */
 };
 
 #endif
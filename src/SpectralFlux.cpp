@@ -16,6 +16,13 @@
  * limitations under the License.
  */
 #include "SpectralFlux.h"
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SPECTRAL_FLUX_SSE
+#endif
 /// @cond
 
 SpectralFlux::SpectralFlux(float inputSampleRate):Plugin(inputSampleRate)
@@ -177,6 +184,8 @@ SpectralFlux::initialise(size_t channels, size_t stepSize, size_t blockSize)
 
     m_blockSize = blockSize;
     m_stepSize = stepSize;
+    prevBin.assign(m_blockSize/2, 0.f);
+    currentBin.assign(m_blockSize/2, 0.f);
     reset();
 
     return true;
@@ -185,43 +194,69 @@ SpectralFlux::initialise(size_t channels, size_t stepSize, size_t blockSize)
 void
 SpectralFlux::reset()
 {
-  prevBin.clear();
+  // previous frame is taken to be silent
+  prevBin.assign(prevBin.size(), 0.f);
 }
 
 SpectralFlux::FeatureSet
 SpectralFlux::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
 {
 	FeatureSet output;
-	float total = 0;
 
-	// for each frequency bin
-	for (int i=0; i<m_blockSize/2; i++)
-	{
-	  // make up previous value if none exists
-	  while (i >= prevBin.size())
-	  {
-	    prevBin.push_back(0.f);
-	  }
+	// find the difference from the previous frame, then keep this frame's
+	// magnitudes for the next by swapping the buffers
+	float total = compareMagnitudes(inputBuffers[0]);
+	std::swap(prevBin, currentBin);
 
-		// get absolute value
-		float bin = abs(complex<float>(inputBuffers[0][i*2], inputBuffers[0][i*2+1]));
+	addFlux(total, output);
+	return output;
+}
 
-		// find difference from prev frame
-		float diff = bin - prevBin.at(i);
+SpectralFlux::FeatureSet
+SpectralFlux::getRemainingFeatures()
+{
+    return FeatureSet();
+}
 
-		// save current frame
-		prevBin.at(i) = bin;
+/// @endcond
 
-		// have-wave rectify
-		if (diff < 0) diff = diff * -1;
+/*!
+ * \brief Calculates the spectral flux of a block from the magnitude of each
+ * FFT bin, which may be shared with other plugins.
+ *
+ * \param binMagnitudes Magnitude of each of the blockSize/2 FFT bins
+ * \param timestamp Time of the block
+ */
+SpectralFlux::FeatureSet
+SpectralFlux::processMagnitudes(const float *binMagnitudes, Vamp::RealTime timestamp)
+{
+	FeatureSet output;
+	processMagnitudes(binMagnitudes, timestamp, output);
+	return output;
+}
 
-		// square if L2 norm
-		if (l2norm) diff = diff*diff;
+/*!
+ * \brief Calculates the spectral flux of a block from the magnitude of each
+ * FFT bin, and adds it to the list in output, which may be reused from block
+ * to block.
+ */
+void
+SpectralFlux::processMagnitudes(const float *binMagnitudes, Vamp::RealTime timestamp,
+                                FeatureSet &output)
+{
+	float total = compareWithPrevious(binMagnitudes);
+	std::swap(prevBin, currentBin);
 
-		// add to total
-		total += diff;
-	}
+	addFlux(total, output);
+}
 
+/*!
+ * \brief Adds the spectral flux of a block to output, given the total
+ * difference from the previous block.
+ */
+void
+SpectralFlux::addFlux(float total, FeatureSet &output)
+{
 	// find root of total if L2 norm
 	if (l2norm) total = sqrt(total);
 
@@ -229,14 +264,110 @@ SpectralFlux::process(const float *const *inputBuffers, Vamp::RealTime timestamp
 	Feature flux;
 	flux.values.push_back(total);
 	output[0].push_back(flux);
-
-  return output;
 }
 
-SpectralFlux::FeatureSet
-SpectralFlux::getRemainingFeatures()
+/*!
+ * \brief Finds the magnitude of each bin of a frame, and returns the total
+ * absolute difference from the previous frame, squaring each difference if
+ * using the L2 norm.
+ *
+ * The magnitudes are saved in currentBin. Where SSE is available, four bins
+ * are deinterleaved and compared at a time, in the same way as
+ * calculateMagnitudes(), so the flux matches that found from shared
+ * magnitudes.
+ *
+ * \param frame Interleaved real and imaginary parts of each bin
+ */
+float
+SpectralFlux::compareMagnitudes(const float *frame)
 {
-    return FeatureSet();
+	int numBins = m_blockSize/2;
+	const float *prev = numBins > 0 ? &prevBin[0] : 0;
+	float *current = numBins > 0 ? &currentBin[0] : 0;
+	float total = 0;
+	int i = 0;
+
+#if defined(SPECTRAL_FLUX_SSE)
+	__m128 sum = _mm_setzero_ps();
+	__m128 signBit = _mm_set1_ps(-0.f);
+	for (; i + 4 <= numBins; i += 4)
+	{
+		__m128 lo = _mm_loadu_ps(frame + i*2);
+		__m128 hi = _mm_loadu_ps(frame + i*2 + 4);
+		__m128 re = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 im = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 bin = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(re, re),
+		                                    _mm_mul_ps(im, im)));
+		_mm_storeu_ps(current + i, bin);
+
+		__m128 diff = _mm_andnot_ps(signBit,
+		                            _mm_sub_ps(bin, _mm_loadu_ps(prev + i)));
+		if (l2norm) diff = _mm_mul_ps(diff, diff);
+		sum = _mm_add_ps(sum, diff);
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, sum);
+	total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+	// finish off the remaining bins
+	for (; i < numBins; i++)
+	{
+		float re = frame[i*2];
+		float im = frame[i*2+1];
+		float bin = std::sqrt(re*re + im*im);
+		current[i] = bin;
+		float diff = std::fabs(bin - prev[i]);
+		if (l2norm) diff = diff*diff;
+		total += diff;
+	}
+	return total;
 }
 
-/// @endcond
+/*!
+ * \brief Returns the total absolute difference between the given magnitudes
+ * and those of the previous frame, squaring each difference if using the L2
+ * norm.
+ *
+ * The magnitudes are saved in currentBin as they are compared.
+ *
+ * \param binMagnitudes Magnitude of each bin
+ */
+float
+SpectralFlux::compareWithPrevious(const float *binMagnitudes)
+{
+	int numBins = m_blockSize/2;
+	const float *prev = numBins > 0 ? &prevBin[0] : 0;
+	float *current = numBins > 0 ? &currentBin[0] : 0;
+	float total = 0;
+	int i = 0;
+
+#if defined(SPECTRAL_FLUX_SSE)
+	__m128 sum = _mm_setzero_ps();
+	__m128 signBit = _mm_set1_ps(-0.f);
+	for (; i + 4 <= numBins; i += 4)
+	{
+		__m128 bin = _mm_loadu_ps(binMagnitudes + i);
+		_mm_storeu_ps(current + i, bin);
+		__m128 diff = _mm_andnot_ps(signBit,
+		                            _mm_sub_ps(bin, _mm_loadu_ps(prev + i)));
+		if (l2norm) diff = _mm_mul_ps(diff, diff);
+		sum = _mm_add_ps(sum, diff);
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, sum);
+	total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+	// finish off the remaining bins
+	for (; i < numBins; i++)
+	{
+		current[i] = binMagnitudes[i];
+		float diff = std::fabs(binMagnitudes[i] - prev[i]);
+		if (l2norm) diff = diff*diff;
+		total += diff;
+	}
+	return total;
+}
@@ -53,6 +53,10 @@ using std::abs;
  *
  * In both cases, \f$ H(x) = \frac{x+|x|}{2} \f$
  *
+ * The magnitudes and differences are found together in one pass, four bins at
+ * a time where SSE is available, and the magnitudes are kept for the next
+ * frame by swapping buffers rather than copying them.
+ *
  * [1] Dixon, S. (2006). Onset Detection Revisited. International Conference on
  * Digital Audio Effects (DAFx) (pp. 133–137).
  */
@@ -89,12 +93,21 @@ public:
                        Vamp::RealTime timestamp);
     FeatureSet getRemainingFeatures();
     /// @endcond
+    FeatureSet processMagnitudes(const float *binMagnitudes,
+                                 Vamp::RealTime timestamp);
+    void processMagnitudes(const float *binMagnitudes,
+                           Vamp::RealTime timestamp, FeatureSet &output);
 
 protected:
+    float compareMagnitudes(const float *frame);
+    float compareWithPrevious(const float *binMagnitudes);
+    void addFlux(float total, FeatureSet &output);
+
     /// @cond
     int m_blockSize, m_stepSize;
     vector<float> prevBin;
     /// @endcond
+    vector<float> currentBin;	/*!< Magnitudes of the current frame, swapped with prevBin once compared */
 
     bool l2norm;	/*!< Flag to indicate use of L2 normalisation */
 };
@@ -26,11 +26,15 @@ SpeechMusicSegmenter::SpeechMusicSegmenter(float inputSampleRate) :
     margin(14),
     change_threshold(0.0781),
     decision_threshold(0.2734),
-    min_music_length(0)
+    min_music_length(0),
+    streaming(false)
     // Also be sure to set your plugin parameters (presumably stored
     // in member variables) to their default values here -- the host
     // will not do that for you
 {
+    for (int k = 0; k < EXTRA_RESOLUTIONS; k++) {
+        extra_resolution[k] = 0;
+    }
 }
 
 SpeechMusicSegmenter::~SpeechMusicSegmenter()
@@ -139,6 +143,20 @@ SpeechMusicSegmenter::getParameterDescriptors() const
     d.quantizeStep = 1;
     list.push_back(d);
 
+    for (int k = 0; k < EXTRA_RESOLUTIONS; k++) {
+        ParameterDescriptor dk;
+        dk.identifier = extraResolutionIdentifier("resolution", k);
+        dk.name = "Resolution " + extraResolutionNumber(k);
+        dk.description = "A further resolution at which to find segment boundaries in the same pass, or 0 for none";
+        dk.unit = "";
+        dk.minValue = 0;
+        dk.maxValue = 1024;
+        dk.defaultValue = 0;
+        dk.isQuantized = true;
+        dk.quantizeStep = 1;
+        list.push_back(dk);
+    }
+
     ParameterDescriptor d21;
     d21.identifier = "change_threshold";
     d21.name = "Change threshold";
@@ -183,6 +201,18 @@ SpeechMusicSegmenter::getParameterDescriptors() const
     d3.isQuantized = false;
     list.push_back(d3);
 
+    ParameterDescriptor d4;
+    d4.identifier = "streaming";
+    d4.name = "Streaming mode";
+    d4.description = "Return the segmentation and detection function during processing";
+    d4.unit = "";
+    d4.minValue = 0;
+    d4.maxValue = 1;
+    d4.defaultValue = 0;
+    d4.isQuantized = true;
+    d4.quantizeStep = 1;
+    list.push_back(d4);
+
     return list;
 }
 
@@ -193,6 +223,12 @@ SpeechMusicSegmenter::getParameter(string identifier) const
         return resolution;
     }
 
+    for (int k = 0; k < EXTRA_RESOLUTIONS; k++) {
+        if (identifier == extraResolutionIdentifier("resolution", k)) {
+            return extra_resolution[k];
+        }
+    }
+
     if (identifier == "change_threshold") {
         return change_threshold;
     }
@@ -209,6 +245,10 @@ SpeechMusicSegmenter::getParameter(string identifier) const
         return margin;
     }
 
+    if (identifier == "streaming") {
+        return streaming;
+    }
+
     std::cerr << "WARNING: SegmenterPlugin::getParameter: unknown parameter \""
               << identifier << "\"" << std::endl;
     return 0.0;
@@ -222,6 +262,13 @@ SpeechMusicSegmenter::setParameter(string identifier, float value)
         return;
     }
 
+    for (int k = 0; k < EXTRA_RESOLUTIONS; k++) {
+        if (identifier == extraResolutionIdentifier("resolution", k)) {
+            extra_resolution[k] = value;
+            return;
+        }
+    }
+
     if (identifier == "change_threshold") {
         change_threshold = value;
         return;
@@ -242,6 +289,11 @@ SpeechMusicSegmenter::setParameter(string identifier, float value)
         return;
     }
 
+    if (identifier == "streaming") {
+        streaming = (value == 1);
+        return;
+    }
+
     std::cerr << "WARNING: SegmenterPlugin::setParameter: unknown parameter \""
               << identifier << "\"" << std::endl;
 }
@@ -306,6 +358,23 @@ SpeechMusicSegmenter::getOutputDescriptors() const
     list.push_back(segmentation);
     list.push_back(skewness);
 
+    // each further resolution has its own pair of outputs
+    for (int k = 0; k < EXTRA_RESOLUTIONS; k++) {
+        if (extra_resolution[k] <= 0) continue;
+
+        OutputDescriptor extraSegmentation = segmentation;
+        extraSegmentation.identifier = extraResolutionIdentifier("segmentation", k);
+        extraSegmentation.name = "Segmentation " + extraResolutionNumber(k);
+        extraSegmentation.description = "Segmentation at resolution " + extraResolutionNumber(k);
+        list.push_back(extraSegmentation);
+
+        OutputDescriptor extraSkewness = skewness;
+        extraSkewness.identifier = extraResolutionIdentifier("skewness", k);
+        extraSkewness.name = "Detection function " + extraResolutionNumber(k);
+        extraSkewness.description = "Detection function at resolution " + extraResolutionNumber(k);
+        list.push_back(extraSkewness);
+    }
+
     return list;
 }
 
@@ -318,6 +387,24 @@ SpeechMusicSegmenter::initialise(size_t channels, size_t stepSize, size_t blockS
     // Real initialisation work goes here!
     m_blockSize = blockSize;
 
+    // one set of zero-crossing counts is shared by every resolution, each
+    // of which keeps its own window over them
+    m_states.clear();
+    m_states.push_back(SkewnessState());
+    resetState(m_states.back(), resolution, 0);
+    int longest = resolution;
+    for (int k = 0; k < EXTRA_RESOLUTIONS; k++) {
+        if (extra_resolution[k] <= 0) continue;
+        m_states.push_back(SkewnessState());
+        resetState(m_states.back(), extra_resolution[k],
+                   2 * (m_states.size() - 1));
+        if (extra_resolution[k] > longest) longest = extra_resolution[k];
+    }
+
+    // the window holds the frames from the one whose skewness is due next,
+    // so keep one more, as the newest frame arrives before the oldest leaves
+    if (streaming) m_zcrHistory.assign(longest + 1, 0);
+
     return true;
 }
 
@@ -325,77 +412,61 @@ void
 SpeechMusicSegmenter::reset()
 {
     // Clear buffers, reset stored values, etc
-    m_zcr.erase(m_zcr.begin(), m_zcr.end());
+    m_zcr.clear();
+    m_zcrWide.clear();
     m_nframes = 0;
+    for (size_t j = 0; j < m_states.size(); j++) {
+        resetState(m_states[j], m_states[j].resolution, m_states[j].output);
+    }
 }
 
 SpeechMusicSegmenter::FeatureSet
 SpeechMusicSegmenter::process(const float *const *inputBuffers, Vamp::RealTime timestamp)
 {
     // Extracting ZCR per frame
-    size_t i = 1;
-    double zc = 0.0;
+    int zeroCrossings = countZeroCrossings(inputBuffers[0], m_blockSize);
 
-    while (i < m_blockSize) {
-        if ((inputBuffers[0][i] * inputBuffers[0][i - 1]) < 0) zc += 1;
-        i += 1;
+    // a single result object lets the compiler return it without a copy
+    FeatureSet features;
+    if (!streaming) {
+        storeZeroCrossingCount(zeroCrossings);
+        m_nframes += 1;
+        return features;
     }
-    zc /= (m_blockSize - 1);
-    m_zcr.push_back(zc);
 
+    m_zcrHistory[m_nframes % m_zcrHistory.size()] = zeroCrossings;
     m_nframes += 1;
 
-    return FeatureSet();
+    // find the skewness of the frame whose window is now complete, at each
+    // resolution
+    double threshold_d = margin / 1000;
+    for (size_t j = 0; j < m_states.size(); j++) {
+        SkewnessState &state = m_states[j];
+        int start = m_nframes - state.resolution;
+        if (start >= 0) {
+            double skewness_value = slideSkewness(state, start, m_nframes,
+                                                  threshold_d);
+            addSkewness(state, skewness_value, features);
+        }
+    }
+    return features;
 }
 
 SpeechMusicSegmenter::FeatureSet
 SpeechMusicSegmenter::getRemainingFeatures()
 {
     FeatureSet features;
-    vector<double> skewness = getSkewnessFunction();
-    double old_mean = 0.0;
-    int feature_size = 0;
-    for (int n = 0; n < m_nframes / resolution; n++) {
-        double mean = 0.0;
-        for (int i = 0; i < resolution; i++) {
-            mean += skewness[n * resolution + i];
-        }
-        mean /= resolution;
-        if ((n > 0 && std::abs(mean - old_mean) > change_threshold) || n == 0) {
-            Feature feature; feature.hasTimestamp = true;
-            feature.timestamp = Vamp::RealTime::frame2RealTime((n * resolution + resolution / 2.0) * m_blockSize, static_cast<unsigned int>(m_inputSampleRate));
-            vector<float> floatval;
-            floatval.push_back(mean);
-            if (mean < decision_threshold) {
-                feature.label = "Music";
-            } else {
-                feature.label = "Speech";
-            }
-            feature.values = floatval;
-            if (feature_size == 0 || (feature_size > 0 && feature.label != features[0].back().label)) {
-                if (feature_size > 0 && features[0].back().label == "Music" && 
-                    (feature.timestamp - features[0].back().timestamp < Vamp::RealTime::fromSeconds(min_music_length))
-                ) {
-                    features[0].pop_back();
-                    feature_size -= 1;
-                } else {
-                    if (feature_size == 0) feature.timestamp = Vamp::RealTime::fromSeconds(0);
-                    features[0].push_back(feature);
-                    feature_size += 1;
-                }
-            }
+    double threshold_d = margin / 1000;
+    for (size_t j = 0; j < m_states.size(); j++) {
+        // in streaming mode, this is only the last frames, whose windows run
+        // past the end of the stream
+        SkewnessState &state = m_states[j];
+        for (int n = state.skewnessFrames; n < m_nframes; n++) {
+            double skewness_value = slideSkewness(state, n, m_nframes,
+                                                  threshold_d);
+            addSkewness(state, skewness_value, features);
         }
-        old_mean = mean;
-    }
-
-    for (unsigned int n = 1; n < skewness.size(); n++) {
-        Feature feature;
-        feature.hasTimestamp = true;
-        feature.timestamp = Vamp::RealTime::frame2RealTime(n * m_blockSize, static_cast<unsigned int>(m_inputSampleRate));
-        vector<float> floatval;
-        floatval.push_back(skewness[n]);
-        feature.values = floatval;
-        features[1].push_back(feature);
+        flushSegments(state, features[state.output]);
     }
 
     return features;
@@ -406,28 +477,337 @@ SpeechMusicSegmenter::getSkewnessFunction()
 {
     double threshold_d = margin / 1000;
     vector<double> skewness;
+    skewness.reserve(m_nframes);
 
-    double mean_zcr;
+    SkewnessState state;
+    resetState(state, resolution, 0);
     for (int n = 0; n < m_nframes; n++) {
-        int i = 0;
-        mean_zcr = 0.0;
-        while (i < resolution && n+i < m_zcr.size()) {
-            mean_zcr += m_zcr[n + i]; 
-            i += 1;
-        }
-        mean_zcr /= resolution;
-        i = 0;
-        int above = 0;
-        int below = 0;
-        while (i < resolution && n+i < m_zcr.size()) {
-            if (m_zcr[n + i] > (mean_zcr + threshold_d)) above += 1;
-            if (m_zcr[n + i] < (mean_zcr - threshold_d)) below += 1;
-            i += 1;
-        } 
-        double skewness_value = below - above;
-        skewness_value /= resolution;
-        skewness.push_back(skewness_value);
+        skewness.push_back(slideSkewness(state, n, m_nframes, threshold_d));
     }
     return skewness;
 }
+
 /// @endcond
+
+/*!
+ * \brief Appends a value to a history, growing it by a quarter at a time
+ * rather than doubling it, in chunks of at least 4096 frames.
+ */
+template <typename T>
+static void
+appendInChunks(vector<T> &history, int value)
+{
+    if (history.size() == history.capacity()) {
+        const size_t chunkFrames = 4096;
+        size_t grow = history.size() / 4;
+        if (grow < chunkFrames) grow = chunkFrames;
+        grow = (grow + chunkFrames - 1) / chunkFrames * chunkFrames;
+        history.reserve(history.size() + grow);
+    }
+    history.push_back((T) value);
+}
+
+/*!
+ * \brief Stores the number of zero crossings in the next frame.
+ *
+ * Counts are kept in 16 bits, unless the blocks are too long for that.
+ */
+void
+SpeechMusicSegmenter::storeZeroCrossingCount(int count)
+{
+    if (m_blockSize - 1 > 65535) {
+        appendInChunks(m_zcrWide, count);
+    } else {
+        appendInChunks(m_zcr, count);
+    }
+}
+
+/*!
+ * \brief Returns the number of zero crossings in a frame.
+ */
+int
+SpeechMusicSegmenter::zeroCrossingCount(int frame) const
+{
+    if (streaming) return m_zcrHistory[frame % m_zcrHistory.size()];
+    if (!m_zcrWide.empty()) return m_zcrWide[frame];
+    return m_zcr[frame];
+}
+
+/*!
+ * \brief Returns the zero-crossing rate of a frame.
+ */
+double
+SpeechMusicSegmenter::zeroCrossingRate(int frame) const
+{
+    double zc = zeroCrossingCount(frame);
+    zc /= (m_blockSize - 1);
+    return zc;
+}
+
+/*!
+ * \brief Returns whether the window holds a frame with the given number of
+ * zero crossings, whose rate is too close to the given rate to be sure which
+ * side of it the frame lies.
+ */
+bool
+SpeechMusicSegmenter::isNearBoundary(const SkewnessState &state, int count,
+                                     double zcr) const
+{
+    if (count < 0 || count > (int) m_blockSize - 1) return false;
+
+    double rate = count;
+    rate /= (m_blockSize - 1);
+    if (std::abs(rate - zcr) > 1e-9) return false;
+
+    return state.window.countBelow(count + 1) > state.window.countBelow(count);
+}
+
+/*!
+ * \brief Returns the skewness of the current window, by scanning every frame
+ * in it.
+ */
+double
+SpeechMusicSegmenter::directSkewness(const SkewnessState &state,
+                                     double threshold_d) const
+{
+    double mean_zcr = 0.0;
+    for (int i = state.windowStart; i < state.windowEnd; i++) {
+        mean_zcr += zeroCrossingRate(i);
+    }
+    mean_zcr /= state.resolution;
+    int above = 0;
+    int below = 0;
+    for (int i = state.windowStart; i < state.windowEnd; i++) {
+        double zcr = zeroCrossingRate(i);
+        if (zcr > (mean_zcr + threshold_d)) above += 1;
+        if (zcr < (mean_zcr - threshold_d)) below += 1;
+    }
+    double skewness_value = below - above;
+    skewness_value /= state.resolution;
+    return skewness_value;
+}
+
+/*!
+ * \brief Returns the lowest zero-crossing count whose rate is above the given
+ * rate, or not below it if inclusive is set.
+ *
+ * The rates are compared exactly as the stored rates would be, so the counts
+ * either side of the result agree with comparing each frame's rate directly.
+ */
+int
+SpeechMusicSegmenter::firstCountAbove(double zcr, bool inclusive) const
+{
+    int maxCount = m_blockSize - 1;
+    int count = (int) floor(zcr * maxCount);
+    if (count < 0) count = 0;
+    if (count > maxCount + 1) count = maxCount + 1;
+
+    // step to the exact boundary, as the estimate may be out by one
+    while (count > 0) {
+        double rate = count - 1;
+        rate /= maxCount;
+        if (inclusive ? rate < zcr : rate <= zcr) break;
+        count -= 1;
+    }
+    while (count <= maxCount) {
+        double rate = count;
+        rate /= maxCount;
+        if (inclusive ? rate >= zcr : rate > zcr) break;
+        count += 1;
+    }
+    return count;
+}
+
+/*!
+ * \brief Clears the skewness window and segment decisions, and sizes the
+ * window for the given resolution, whose features go to the given output and
+ * the one after it.
+ */
+void
+SpeechMusicSegmenter::resetState(SkewnessState &state, int stateResolution,
+                                 int output)
+{
+    state.resolution = stateResolution;
+    state.output = output;
+    state.window.initialise(stateResolution);
+    state.total = 0;
+    state.windowStart = 0;
+    state.windowEnd = 0;
+    state.skewnessFrames = 0;
+    state.blockTotal = 0.0;
+    state.oldMean = 0.0;
+    state.segmentCount = 0;
+    state.lastLabel = "";
+    state.pending = false;
+}
+
+/*!
+ * \brief Moves the window on to start at the given frame, and returns its
+ * skewness.
+ *
+ * The window covers the resolution frames from the start, or as many of them
+ * as have arrived, of the given number of frames.
+ */
+double
+SpeechMusicSegmenter::slideSkewness(SkewnessState &state, int start,
+                                    int frames, double threshold_d)
+{
+    while (state.windowStart < start) {
+        int count = zeroCrossingCount(state.windowStart);
+        state.window.remove(count);
+        state.total -= count;
+        state.windowStart += 1;
+    }
+    if (state.windowEnd < start) state.windowEnd = start;
+    while (state.windowEnd < start + state.resolution &&
+           state.windowEnd < frames) {
+        int count = zeroCrossingCount(state.windowEnd);
+        state.window.insert(count);
+        state.total += count;
+        state.windowEnd += 1;
+    }
+
+    double mean_zcr = (double) state.total / (m_blockSize - 1);
+    mean_zcr /= state.resolution;
+
+    // count the frames above and below the margin around the mean
+    int above = 0;
+    int below = 0;
+    int aboveCount = firstCountAbove(mean_zcr + threshold_d, false);
+    int belowCount = firstCountAbove(mean_zcr - threshold_d, true);
+    if (state.window.size() > 0) {
+        above = state.window.size() - state.window.countBelow(aboveCount);
+        below = state.window.countBelow(belowCount);
+    }
+    double skewness_value = below - above;
+    skewness_value /= state.resolution;
+
+    // a rate which is level with an edge of the margin could fall
+    // either side of it depending on how the mean is rounded, so
+    // recount those windows in the original order
+    if (isNearBoundary(state, aboveCount - 1, mean_zcr + threshold_d) ||
+        isNearBoundary(state, aboveCount, mean_zcr + threshold_d) ||
+        isNearBoundary(state, belowCount - 1, mean_zcr - threshold_d) ||
+        isNearBoundary(state, belowCount, mean_zcr - threshold_d)) {
+        skewness_value = directSkewness(state, threshold_d);
+    }
+    return skewness_value;
+}
+
+/*!
+ * \brief Returns the skewness of the next frame as a feature, and classifies
+ * the block it completes, if any.
+ */
+void
+SpeechMusicSegmenter::addSkewness(SkewnessState &state, double skewness_value,
+                                  FeatureSet &features)
+{
+    int n = state.skewnessFrames;
+    if (n > 0) {
+        Feature feature;
+        feature.hasTimestamp = true;
+        feature.timestamp = Vamp::RealTime::frame2RealTime(n * m_blockSize, static_cast<unsigned int>(m_inputSampleRate));
+        feature.values.push_back(skewness_value);
+        features[state.output + 1].push_back(feature);
+    }
+
+    state.blockTotal += skewness_value;
+    state.skewnessFrames += 1;
+    if (state.skewnessFrames % state.resolution == 0) {
+        double mean = state.blockTotal / state.resolution;
+        addSegmentBlock(state, state.skewnessFrames / state.resolution - 1,
+                        mean, features[state.output]);
+        state.blockTotal = 0.0;
+    }
+}
+
+/*!
+ * \brief Decides whether a block starts a new segment, given the mean of its
+ * skewness, and returns any segments which can no longer change.
+ *
+ * A music segment is held back until it can no longer be dismissed, which is
+ * when the next block starts at least the minimum music length after it.
+ */
+void
+SpeechMusicSegmenter::addSegmentBlock(SkewnessState &state, int block,
+                                      double mean, FeatureList &segments)
+{
+    int r = state.resolution;
+    unsigned int sr = static_cast<unsigned int>(m_inputSampleRate);
+    Vamp::RealTime minLength = Vamp::RealTime::fromSeconds(min_music_length);
+
+    if (block == 0 || std::abs(mean - state.oldMean) > change_threshold) {
+        Feature feature; feature.hasTimestamp = true;
+        feature.timestamp = Vamp::RealTime::frame2RealTime((block * r + r / 2.0) * m_blockSize, sr);
+        vector<float> floatval;
+        floatval.push_back(mean);
+        if (mean < decision_threshold) {
+            feature.label = "Music";
+        } else {
+            feature.label = "Speech";
+        }
+        feature.values = floatval;
+        if (state.segmentCount == 0 || feature.label != state.lastLabel) {
+            if (state.segmentCount > 0 && state.lastLabel == "Music" &&
+                feature.timestamp - state.lastTimestamp < minLength) {
+                // segments alternate, so the one before was speech
+                state.pending = false;
+                state.segmentCount -= 1;
+                state.lastLabel = "Speech";
+                state.lastTimestamp = state.prevTimestamp;
+            } else {
+                flushSegments(state, segments);
+                if (state.segmentCount == 0) feature.timestamp = Vamp::RealTime::fromSeconds(0);
+                state.segmentCount += 1;
+                state.prevTimestamp = state.lastTimestamp;
+                state.lastLabel = feature.label;
+                state.lastTimestamp = feature.timestamp;
+                if (feature.label == "Music") {
+                    state.pending = true;
+                    state.pendingFeature = feature;
+                } else {
+                    segments.push_back(feature);
+                }
+            }
+        }
+    }
+    state.oldMean = mean;
+
+    if (state.pending) {
+        Vamp::RealTime next = Vamp::RealTime::frame2RealTime(((block + 1) * r + r / 2.0) * m_blockSize, sr);
+        if (!(next - state.lastTimestamp < minLength)) {
+            flushSegments(state, segments);
+        }
+    }
+}
+
+/*!
+ * \brief Returns the music segment held back, if any.
+ */
+void
+SpeechMusicSegmenter::flushSegments(SkewnessState &state, FeatureList &segments)
+{
+    if (!state.pending) return;
+    segments.push_back(state.pendingFeature);
+    state.pending = false;
+}
+
+/*!
+ * \brief Returns the identifier of a parameter or output for one of the
+ * further resolutions, such as "resolution_2".
+ */
+string
+SpeechMusicSegmenter::extraResolutionIdentifier(string name, int k) const
+{
+    return name + "_" + extraResolutionNumber(k);
+}
+
+/*!
+ * \brief Returns the number of one of the further resolutions, counting the
+ * main resolution as the first.
+ */
+string
+SpeechMusicSegmenter::extraResolutionNumber(int k) const
+{
+    return string(1, (char) ('2' + k));
+}
@@ -20,12 +20,39 @@
 
 #include <vector>
 #include <vamp-sdk/Plugin.h>
+#include "BlockStatistics.h"
+#include "OrderStatisticWindow.h"
 #include <math.h>
 #include <cmath>
 
 using std::string;
 using std::vector;
 
+/*!
+ * \brief State of the skewness window and of the segment decisions for one
+ * resolution
+ */
+struct SkewnessState
+{
+    int resolution;                 /*!< Number of frames in the window and in each block */
+    int output;                     /*!< Index of the segmentation output,
+                                         which the detection function
+                                         follows */
+    OrderStatisticWindow window;    /*!< Zero-crossing counts in the window, in order */
+    long long total;                /*!< Total of the zero-crossing counts in the window */
+    int windowStart;                /*!< First frame in the window */
+    int windowEnd;                  /*!< Frame after the last one in the window */
+    int skewnessFrames;             /*!< Number of skewness values found */
+    double blockTotal;              /*!< Total of the skewness in the current block */
+    double oldMean;                 /*!< Mean skewness of the previous block */
+    int segmentCount;               /*!< Number of segments kept */
+    string lastLabel;               /*!< Type of the last segment kept */
+    Vamp::RealTime lastTimestamp;   /*!< Start of the last segment kept */
+    Vamp::RealTime prevTimestamp;   /*!< Start of the segment before it */
+    bool pending;                   /*!< Whether the last segment is music which may yet be dropped */
+    Vamp::Plugin::Feature pendingFeature; /*!< The last segment, while pending */
+};
+
 /*!
  * \brief Calculates boundaries between speech and music
  *
@@ -34,11 +61,16 @@ using std::vector;
  * Impulses at the boundary points.
  * \par Detection function
  * Function used to find boundaries.
+ * \par Segmentation 2-5, Detection function 2-5
+ * The same outputs for each further resolution that is set.
  *
  * \section Parameters
  * \par Resolution
  * The number of frames defining the window at which candidate changes might
  * be found (default = 256)
+ * \par Resolution 2-5
+ * Further resolutions to find boundaries at in the same pass, or 0 for none
+ * (default = 0)
  * \par Change threshold
  * The threshold of skewness difference at which a candidate change will be marked
  * (default = 0.0781)
@@ -50,6 +82,9 @@ using std::vector;
  * \par Minimum music segment length
  * Music segments that are shorter than this minimum length will be dismissed
  * (default = 0)
+ * \par Streaming mode
+ * Whether to return the segmentation and detection function during processing
+ * rather than at the end of the stream (default = 0)
  *
  * \section Description
  *
@@ -65,6 +100,28 @@ using std::vector;
  * -# If the segment has the same type with the previous one, merge it with
  * the previous one.
  *
+ * The skewness window slides forward one frame at a time, so the total of the
+ * zero-crossing counts inside it is kept as a running sum, and the counts are
+ * kept sorted to find how many lie above and below the margin. This takes
+ * \f$O(n \log r)\f$ time for \f$n\f$ frames and a resolution of \f$r\f$,
+ * rather than \f$O(nr)\f$. When further resolutions are set, they share the
+ * zero-crossing counts, and each keeps its own window and segment decisions,
+ * so each adds only the cost of its own window to the pass. Only the
+ * zero-crossing count of each frame is kept, in 16 bits where the block size
+ * allows, and the rates are found from the counts as they are needed.
+ *
+ * In <b>streaming mode</b>, only the zero-crossing counts inside the skewness
+ * window are kept, so the memory used does not grow with the length of the
+ * stream. The skewness of each frame is returned once the window ahead of it
+ * has arrived, resolution - 1 frames later. Each block of resolution frames is
+ * classified as soon as the skewness of its last frame is known, and a speech
+ * segment is returned straight away, up to 2 x resolution frames after it
+ * starts. As a music segment is dismissed if speech follows it within the
+ * minimum music segment length, it is only returned once that length has
+ * passed, or once the segment after it is known. At the end of the stream, the
+ * skewness of the last frames is found from the frames that remain, as
+ * normal.
+ *
  * This is a very early prototype, so not very accurate. It is relatively fast
  * (around 1s to process a 20 minute file).
  *
@@ -114,16 +171,43 @@ public:
     /// @endcond
 
 protected:
+    void storeZeroCrossingCount(int count);
+    int zeroCrossingCount(int frame) const;
+    double zeroCrossingRate(int frame) const;
+    int firstCountAbove(double zcr, bool inclusive) const;
+    bool isNearBoundary(const SkewnessState &state, int count, double zcr) const;
+    double directSkewness(const SkewnessState &state, double threshold_d) const;
+    void resetState(SkewnessState &state, int stateResolution, int output);
+    double slideSkewness(SkewnessState &state, int start, int frames,
+                         double threshold_d);
+    void addSkewness(SkewnessState &state, double skewness_value,
+                     FeatureSet &features);
+    void addSegmentBlock(SkewnessState &state, int block, double mean,
+                         FeatureList &segments);
+    void flushSegments(SkewnessState &state, FeatureList &segments);
+    string extraResolutionIdentifier(string name, int k) const;
+    string extraResolutionNumber(int k) const;
+
+    enum { EXTRA_RESOLUTIONS = 4 };     /*!< Number of further resolutions
+                                             which can be set */
+
     /// @cond
     size_t m_blockSize;
     /// @endcond
-    vector<double> m_zcr;
+    vector<unsigned short> m_zcr;   /*!< Zero-crossing count of each frame */
+    vector<int> m_zcrWide;          /*!< Zero-crossing count of each frame, when too many for 16 bits */
     int m_nframes;
     int resolution;
+    int extra_resolution[EXTRA_RESOLUTIONS];    /*!< Further resolutions, or
+                                                     0 where unset */
     double margin;
     double change_threshold;
     double decision_threshold;
     double min_music_length;
+    bool streaming;             /*!< Flag to indicate whether to return features during processing */
+    vector<int> m_zcrHistory;   /*!< Circular buffer of recent zero-crossing counts, when streaming */
+    vector<SkewnessState> m_states; /*!< Skewness window and segment
+                                         decisions for each resolution */
 };
 
 
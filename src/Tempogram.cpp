@@ -0,0 +1,219 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "Tempogram.h"
+#include <algorithm>
+
+Tempogram::Tempogram() {
+  hop = 1;
+  windowBlocks = 1;
+  firstShift = 0;
+  lastShift = 0;
+  count = 0;
+  blocks = 0;
+  windows = 0;
+  readyPos = 0;
+}
+
+/*!
+ * \brief Sets the hop and window length (rounded up to a whole number of
+ * hops) in values, and the range of delays to find the autocorrelation for.
+ */
+void Tempogram::initialise(int hop, int windowLength, int firstShift,
+                           int lastShift) {
+  this->hop = hop < 1 ? 1 : hop;
+  windowBlocks = (windowLength + this->hop - 1) / this->hop;
+  if (windowBlocks < 1)
+    windowBlocks = 1;
+  this->lastShift = lastShift < 1 ? 1 : lastShift;
+  this->firstShift = firstShift < 0 ? 0 : firstShift;
+  if (this->firstShift > this->lastShift)
+    this->firstShift = this->lastShift;
+
+  // a block is correlated with the values up to the longest delay after it
+  int shifts = this->lastShift - this->firstShift;
+  fft.initialise(FourierTransform::nextPowerOfTwo(this->hop + this->lastShift
+                                                  - 1));
+  real.assign(fft.getSize(), 0.0);
+  imag.assign(fft.getSize(), 0.0);
+  history.assign(this->hop + this->lastShift, 0.f);
+  blockCorrelation.assign(windowBlocks * shifts, 0.0);
+  windowTotal.assign(shifts, 0.0);
+
+  // each value completes at most one window, so there is room for the
+  // window completed by each push() without allocating
+  ready.reserve(shifts);
+  readyStart.reserve(1);
+  readyLength.reserve(1);
+  reset();
+}
+
+/*!
+ * \brief Removes all values and windows, without releasing memory.
+ */
+void Tempogram::reset() {
+  count = 0;
+  blocks = 0;
+  windows = 0;
+  std::fill(windowTotal.begin(), windowTotal.end(), 0.0);
+  ready.clear();
+  readyStart.clear();
+  readyLength.clear();
+  readyPos = 0;
+}
+
+/*!
+ * \brief Adds the next value of the signal.
+ */
+void Tempogram::push(float value) {
+  history[count % history.size()] = value;
+  count++;
+
+  // correlate the next block once all of its delayed values have arrived
+  if ((blocks + 1) * hop + lastShift - 1 <= count)
+    addBlockCorrelation();
+}
+
+/*!
+ * \brief Completes the remaining windows at the end of the signal.
+ *
+ * If the signal was too short to fill a single window, one window covering
+ * the whole signal is returned instead.
+ */
+void Tempogram::finish() {
+  while (blocks * hop < count)
+    addBlockCorrelation();
+
+  if (windows == 0 && count > 0) {
+    for (unsigned shift = 0; shift < windowTotal.size(); shift++)
+      ready.push_back(windowTotal[shift] / count);
+    readyStart.push_back(0);
+    readyLength.push_back(count);
+    windows++;
+  }
+}
+
+/*!
+ * \brief Returns the autocorrelation of the next completed window, with the
+ * position and number of its values, or false if there are none left.
+ */
+bool Tempogram::popWindow(vector<float>& autocor_out, int& start_out,
+                          int& length_out) {
+  if (readyPos >= readyStart.size()) {
+    ready.clear();
+    readyStart.clear();
+    readyLength.clear();
+    readyPos = 0;
+    return false;
+  }
+
+  int shifts = windowTotal.size();
+  autocor_out.assign(ready.begin() + readyPos * shifts,
+                     ready.begin() + (readyPos + 1) * shifts);
+  start_out = readyStart[readyPos];
+  length_out = readyLength[readyPos];
+  readyPos++;
+  return true;
+}
+
+/*!
+ * \brief Returns the number of values between the start of each window.
+ */
+int Tempogram::getHop() const {
+  return hop;
+}
+
+/*!
+ * \brief Returns the number of values in each window.
+ */
+int Tempogram::getWindowLength() const {
+  return windowBlocks * hop;
+}
+
+/*!
+ * \brief Finds the correlation of the next block, and updates the current
+ * window with it.
+ */
+void Tempogram::addBlockCorrelation() {
+  int shifts = windowTotal.size();
+  double *slot = shifts ? &blockCorrelation[(blocks % windowBlocks) * shifts]
+      : NULL;
+
+  // drop the block which has left the window, and add the new one
+  if (blocks >= windowBlocks) {
+    for (int shift = 0; shift < shifts; shift++)
+      windowTotal[shift] -= slot[shift];
+  }
+  correlateBlock();
+  for (int shift = 0; shift < shifts; shift++) {
+    slot[shift] = real[firstShift + shift];
+    windowTotal[shift] += slot[shift];
+  }
+  blocks++;
+
+  // return the window which ends with this block
+  if (blocks >= windowBlocks) {
+    int start = (blocks - windowBlocks) * hop;
+    int length = count - start;
+    if (length > windowBlocks * hop)
+      length = windowBlocks * hop;
+    for (int shift = 0; shift < shifts; shift++)
+      ready.push_back(windowTotal[shift] / length);
+    readyStart.push_back(start);
+    readyLength.push_back(length);
+    windows++;
+  }
+}
+
+/*!
+ * \brief Finds the sum of products of each value in the next block with the
+ * values at each delay after it, leaving the result for each delay in real.
+ *
+ * The block goes in the real part and the values it is correlated with in
+ * the imaginary part, so that one forward transform covers both. Values which
+ * have not arrived are treated as zero.
+ */
+void Tempogram::correlateBlock() {
+  int size = fft.getSize();
+  int start = blocks * hop;
+  int span = hop + lastShift - 1;
+  int historySize = history.size();
+
+  for (int i = 0; i < size; i++) {
+    float value = 0.f;
+    if (i < span && start + i < count)
+      value = history[(start + i) % historySize];
+    real[i] = i < hop ? value : 0.0;
+    imag[i] = value;
+  }
+  fft.forward(&real[0], &imag[0]);
+
+  // separate the two spectra, and multiply the conjugate of the block's
+  // spectrum by the other, which is real-symmetric
+  for (int m = 0; m <= size / 2; m++) {
+    int n = (size - m) % size;
+    double a = real[m], b = imag[m];
+    double c = real[n], d = imag[n];
+    double productReal = ((a + c) * (b + d) + (b - d) * (c - a)) / 4.0;
+    double productImag = ((c * c - a * a) - (b * b - d * d)) / 4.0;
+    real[m] = productReal;
+    imag[m] = productImag;
+    real[n] = productReal;
+    imag[n] = -productImag;
+  }
+  fft.inverse(&real[0], &imag[0]);
+}
@@ -0,0 +1,76 @@
+/**
+ * BBC Vamp plugin collection
+ *
+ * Copyright (c) 2014 British Broadcasting Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef _TEMPOGRAM_H_
+#define _TEMPOGRAM_H_
+
+#include <vector>
+#include "FourierTransform.h"
+
+using std::vector;
+
+/*!
+ * \brief Autocorrelation of a signal over a sliding window
+ *
+ * The signal is split into blocks of one hop, and for each block the
+ * products of its values with the values up to the longest delay after them
+ * are summed. These block correlations are found with an FFT, and each is
+ * found only once, however many windows it belongs to. The correlation of a
+ * window is the running total of the block correlations inside it, so the
+ * cost grows linearly with the length of the signal.
+ *
+ * Values are added one at a time with push(), and each window is available
+ * from popWindow() once the values after it, up to the longest delay, have
+ * been added. finish() completes the remaining windows as if the signal was
+ * followed by zeros.
+ */
+class Tempogram {
+ public:
+  Tempogram();
+  void initialise(int hop, int windowLength, int firstShift, int lastShift);
+  void reset();
+  void push(float value);
+  void finish();
+  bool popWindow(vector<float>& autocor_out, int& start_out, int& length_out);
+  int getHop() const;
+  int getWindowLength() const;
+
+ protected:
+  void correlateBlock();
+  void addBlockCorrelation();
+
+  int hop;                /*!< Number of values in each block */
+  int windowBlocks;       /*!< Number of blocks in each window */
+  int firstShift;         /*!< Shortest delay of the autocorrelation */
+  int lastShift;          /*!< Longest delay of the autocorrelation (exclusive) */
+  int count;              /*!< Number of values added */
+  int blocks;             /*!< Number of blocks correlated */
+  int windows;            /*!< Number of windows completed */
+  vector<float> history;  /*!< Circular buffer of recent values */
+  vector<double> blockCorrelation; /*!< Circular buffer of the correlation of
+                                        each block in the current window */
+  vector<double> windowTotal;      /*!< Correlation of the current window */
+  vector<float> ready;    /*!< Autocorrelation of completed windows */
+  vector<int> readyStart; /*!< First value of each completed window */
+  vector<int> readyLength; /*!< Number of values in each completed window */
+  unsigned readyPos;      /*!< Next completed window to return */
+  FourierTransform fft;   /*!< Transform covering a block and its delays */
+  vector<double> real;    /*!< Scratch space for the transform */
+  vector<double> imag;    /*!< Scratch space for the transform */
+};
+
+#endif
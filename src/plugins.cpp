@@ -12,6 +12,7 @@
 #include "SpectralContrast.h"
 #include "SpeechMusicSegmenter.h"
 #include "Peaks.h"
+#include "LowLevelBundle.h"
 
 // Declare one static adapter here for each plugin class in this library.
 
@@ -22,6 +23,7 @@ static Vamp::PluginAdapter<Rhythm> rhythm;
 static Vamp::PluginAdapter<SpectralContrast> spectralcontrast;
 static Vamp::PluginAdapter<SpeechMusicSegmenter> speechMusicSegmenter;
 static Vamp::PluginAdapter<Peaks> peaks;
+static Vamp::PluginAdapter<LowLevelBundle> lowLevelBundle;
 
 // This is the entry-point for the library, and the only function that
 // needs to be publicly exported.
@@ -51,6 +53,8 @@ vampGetPluginDescriptor(unsigned int version, unsigned int index) {
 		return speechMusicSegmenter.getDescriptor();
   case 6:
     return peaks.getDescriptor();
+  case 7:
+    return lowLevelBundle.getDescriptor();
 	default:
 		return 0;
 	}